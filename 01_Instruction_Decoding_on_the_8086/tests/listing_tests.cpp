@@ -2,10 +2,12 @@
 #include <filesystem>
 #include <fstream>
 #include <cstdlib>
+#include <cstring>
 #include <vector>
 #include <string>
 #include <format>
 #include <decompile.h>
+#include <encode.h>
 
 #ifdef _WIN32
 
@@ -15,7 +17,9 @@
 
 namespace fs = std::filesystem;
 
+#ifdef NASM_CROSS_CHECK
 static const std::string NASM = NASM_EXEC;
+#endif
 static const std::string ASM_DIR = ASM_LISTINGS_DIR;
 static const std::string DISASM = LESSON_EXE;
 static const std::string WORK_BASE = WORK_BASE_DIR;
@@ -39,11 +43,13 @@ std::string getShortPathName(const std::string &longPath) {
 #endif
 }
 
+#ifdef NASM_CROSS_CHECK
 // helper to read a file into memory
-static std::vector<char> read_bytes(const fs::path &p) {
+static std::vector<uint8_t> read_bytes(const fs::path &p) {
     std::ifstream in(p, std::ios::binary);
     return {std::istreambuf_iterator<char>(in), {}};
 }
+#endif
 
 std::string slurp_file(const std::filesystem::path &p) {
     std::ifstream in(p, std::ios::binary);
@@ -65,8 +71,9 @@ static std::vector<fs::path> collect_listings() {
     return v;
 }
 
-// … all your includes, namespace aliases, helper functions, etc. …
-
+// Assembling and disassembling happen in memory with the in-process encoder shared with lesson 02. Files in
+// WORK_BASE are only written for the application test and for the optional NASM cross-check
+// (-DNASM_CROSS_CHECK=ON).
 struct DisasmTest : ::testing::TestWithParam<fs::path> {
     fs::path src;
     fs::path workDir;
@@ -74,40 +81,63 @@ struct DisasmTest : ::testing::TestWithParam<fs::path> {
     fs::path outAsm;
     fs::path recompBin;
 
+    std::string referenceAsm;
+    std::vector<uint8_t> origBinary;
+    std::string disassembledAsm;
+    std::vector<uint8_t> recompBinary;
+
     void SetUp() override {
         src = GetParam();
         workDir = fs::path(WORK_BASE) / src.stem();
-        fs::create_directories(workDir);
 
         origBin = workDir / "orig.bin";
         outAsm = workDir / "out.asm";
         recompBin = workDir / "recomp.bin";
 
+        referenceAsm = slurp_file(src);
+
         spdlog::set_level(spdlog::level::debug);
     }
 
-    void AssembleOriginal() {
+    // Optional run that checks the in-process encoder against NASM on the same source
+    void CrossCheckWithNasm([[maybe_unused]] std::string_view source, [[maybe_unused]] const fs::path &asmPath,
+                            [[maybe_unused]] const fs::path &binPath,
+                            [[maybe_unused]] const std::vector<uint8_t> &expected) {
+#ifdef NASM_CROSS_CHECK
+        fs::create_directories(workDir);
+        std::ofstream{asmPath} << source;
+
         std::string cmd = std::format(
                 R"({} -f bin -o {} {})",
                 getShortPathName(NASM),
-                getShortPathName(origBin.string()),
-                getShortPathName(src.string())
+                getShortPathName(binPath.string()),
+                getShortPathName(asmPath.string())
         );
         ASSERT_EQ(std::system(cmd.c_str()), 0)
-                                    << "NASM failed on " << src;
+                                    << "NASM failed on " << asmPath;
+        EXPECT_EQ(read_bytes(binPath), expected) << "In-process encoder disagrees with NASM on " << asmPath;
+#endif
     }
 
-    void DisassembleOrigWithSource() {
-        auto binaryData = readFile(origBin.string());
-        auto source = decompile(binaryData);
+    void AssembleOriginal() {
+        auto binary = assemble(referenceAsm);
+        ASSERT_TRUE(binary.has_value()) << "Encoder failed on " << src;
+        origBinary = std::move(binary.value());
 
-        std::ofstream ofs(outAsm.string());
-        ASSERT_TRUE(ofs) << "Error: could not open file for writing: " << outAsm.string();
+        CrossCheckWithNasm(referenceAsm, workDir / "orig.asm", origBin, origBinary);
+    }
 
-        ofs << source;
+    void DisassembleOrigWithSource() {
+        std::vector<std::byte> binaryData(origBinary.size());
+        std::memcpy(binaryData.data(), origBinary.data(), origBinary.size());
+        disassembledAsm = decompile(binaryData);
     }
 
     void DisassembleOrigWithBinary() {
+        fs::create_directories(workDir);
+        std::ofstream(origBin, std::ios::binary)
+                .write(reinterpret_cast<const char *>(origBinary.data()), static_cast<std::streamsize>(origBinary.size()));
+
         std::string cmd = std::format(
                 R"({} {} > {})",
                 getShortPathName(DISASM),
@@ -116,17 +146,16 @@ struct DisasmTest : ::testing::TestWithParam<fs::path> {
         );
         ASSERT_EQ(std::system(cmd.c_str()), 0)
                                     << "Failed to decompile the binary";
+
+        disassembledAsm = slurp_file(outAsm);
     }
 
     void ReassembleOut() {
-        std::string cmd = std::format(
-                R"({} -f bin -o {} {})",
-                getShortPathName(NASM),
-                getShortPathName(recompBin.string()),
-                getShortPathName(outAsm.string())
-        );
-        ASSERT_EQ(std::system(cmd.c_str()), 0)
-                                    << "NASM failed on reconstructed asm";
+        auto binary = assemble(disassembledAsm);
+        ASSERT_TRUE(binary.has_value()) << "Encoder failed on reconstructed asm:\n" << disassembledAsm;
+        recompBinary = std::move(binary.value());
+
+        CrossCheckWithNasm(disassembledAsm, outAsm, recompBin, recompBinary);
     }
 };
 
@@ -150,11 +179,7 @@ TEST_P(DisasmTest, CompareBinariesDebugSource) {
     DisassembleOrigWithSource();
     ReassembleOut();
 
-    auto a = read_bytes(origBin);
-    auto b = read_bytes(recompBin);
-    auto disassembledAsm = slurp_file(outAsm);
-    auto referenceAsm = slurp_file(src);
-    EXPECT_EQ(a, b) << "Disassembled asm: \n" << disassembledAsm << "\n\nReference asm: \n" << referenceAsm << "\n";
+    EXPECT_EQ(origBinary, recompBinary) << "Disassembled asm: \n" << disassembledAsm << "\n\nReference asm: \n" << referenceAsm << "\n";
 }
 
 TEST_P(DisasmTest, CompareBinariesDebugApplication) {
@@ -162,11 +187,7 @@ TEST_P(DisasmTest, CompareBinariesDebugApplication) {
     DisassembleOrigWithBinary();
     ReassembleOut();
 
-    auto a = read_bytes(origBin);
-    auto b = read_bytes(recompBin);
-    auto disassembledAsm = slurp_file(outAsm);
-    auto referenceAsm = slurp_file(src);
-    EXPECT_EQ(a, b) << "Disassembled asm: \n" << disassembledAsm << "\n\nReference asm: \n" << referenceAsm << "\n";
+    EXPECT_EQ(origBinary, recompBinary) << "Disassembled asm: \n" << disassembledAsm << "\n\nReference asm: \n" << referenceAsm << "\n";
 }
 
 INSTANTIATE_TEST_SUITE_P(
@@ -0,0 +1,114 @@
+// Benchmark for the control flow pass (control_flow.h) on generated branchy code: MOVs with a conditional
+// jump or loop every few instructions, plus jmp near, call and ret, and an entry point every 64
+// instructions like a table of functions. The image doubles at each step up to the given size, so the time
+// per byte shows whether the passes stay linear.
+
+#include <control_flow.h>
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <random>
+
+struct BranchyCode {
+    std::vector<uint8_t> bytes;
+    std::vector<size_t> entryPoints;
+};
+
+// Every branch targets the start of another instruction within reach of its displacement
+static BranchyCode generateBranchyCode(size_t size, uint32_t seed) {
+    enum class Slot : uint8_t { Mov, Short, Near };
+
+    std::mt19937 rng(seed);
+    std::vector<uint8_t> bytes;
+    std::vector<uint32_t> starts;
+    std::vector<Slot> slots;
+    bytes.reserve(size + 3);
+
+    while (bytes.size() < size) {
+        starts.push_back(static_cast<uint32_t>(bytes.size()));
+        auto choice = rng() % 16;
+        if (choice < 10) {
+            slots.push_back(Slot::Mov);
+            if (choice % 2) {
+                bytes.insert(bytes.end(), {0x89, static_cast<uint8_t>(0b11000000 | (rng() & 0b111111))});
+            } else {
+                bytes.insert(bytes.end(), {static_cast<uint8_t>(0b10111000 | (rng() & 0b111)),
+                                           static_cast<uint8_t>(rng()), static_cast<uint8_t>(rng())});
+            }
+        } else if (choice < 14) {
+            slots.push_back(Slot::Short);
+            auto opcode = choice == 13 ? 0xe0 | (rng() % 4) : 0x70 | (rng() % 16);
+            bytes.insert(bytes.end(), {static_cast<uint8_t>(opcode), 0});
+        } else if (choice == 14) {
+            slots.push_back(Slot::Near);
+            bytes.insert(bytes.end(), {static_cast<uint8_t>(rng() % 2 ? 0xe8 : 0xe9), 0, 0});
+        } else {
+            slots.push_back(Slot::Mov);
+            bytes.push_back(0xc3);
+        }
+    }
+
+    // Instructions are at most 3 bytes, so 40 instructions either way stay within disp8 and 10000 within disp16
+    BranchyCode code;
+    for (size_t i = 0; i < starts.size(); i++) {
+        if (i % 64 == 0) {
+            code.entryPoints.push_back(starts[i]);
+        }
+        if (slots[i] == Slot::Mov) {
+            continue;
+        }
+
+        auto reach = slots[i] == Slot::Short ? 40 : 10'000;
+        auto j = std::clamp<int64_t>(static_cast<int64_t>(i) + static_cast<int64_t>(rng() % (2 * reach + 1)) - reach,
+                                     0, static_cast<int64_t>(starts.size()) - 1);
+        auto length = slots[i] == Slot::Short ? 2 : 3;
+        auto displacement = static_cast<int64_t>(starts[j]) - (starts[i] + length);
+        bytes[starts[i] + 1] = static_cast<uint8_t>(displacement & 0xff);
+        if (slots[i] == Slot::Near) {
+            bytes[starts[i] + 2] = static_cast<uint8_t>((displacement >> 8) & 0xff);
+        }
+    }
+
+    code.bytes = std::move(bytes);
+    return code;
+}
+
+static size_t parseSize(const char *text, size_t fallback) {
+    size_t value = 0;
+    std::string_view raw{text};
+    auto [end, error] = std::from_chars(raw.data(), raw.data() + raw.size(), value);
+    return error == std::errc{} && end == raw.data() + raw.size() && value > 0 ? value : fallback;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 3) {
+        std::cerr << std::format("Usage: {} [max-size-mib] [seed]\n", fs::path{argv[0]}.filename().string());
+        return 1;
+    }
+
+    auto maxSize = (argc > 1 ? parseSize(argv[1], 64) : 64) << 20;
+    auto seed = static_cast<uint32_t>(argc > 2 ? parseSize(argv[2], 1) : 1);
+
+    std::cout << std::format("{:>10} {:>10} {:>14} {:>14} {:>14}\n",
+                             "size", "targets", "analyze ns/B", "emit ns/B", "total MiB/s");
+    for (size_t size = 1 << 20; size <= maxSize; size *= 2) {
+        auto [binaryData, entryPoints] = generateBranchyCode(size, seed);
+
+        auto start = std::chrono::steady_clock::now();
+        auto flow = analyzeControlFlow(binaryData, entryPoints);
+        auto analyzeNs = nanosecondsSince(start);
+
+        start = std::chrono::steady_clock::now();
+        auto source = decompileWithLabels(binaryData, flow);
+        auto emitNs = nanosecondsSince(start);
+
+        auto bytes = static_cast<double>(binaryData.size());
+        std::cout << std::format("{:>9}K {:>10} {:>14.2f} {:>14.2f} {:>14.1f}\n",
+                                 binaryData.size() >> 10, flow.labels.count(),
+                                 static_cast<double>(analyzeNs) / bytes, static_cast<double>(emitNs) / bytes,
+                                 bytes / (1 << 20) / (static_cast<double>(analyzeNs + emitNs) * 1e-9));
+    }
+
+    return 0;
+}
@@ -0,0 +1,86 @@
+// Load generator for `02_lesson --daemon=<socket-path>`: sends the same input from several connections
+// and reports request latency percentiles and throughput.
+
+#include <daemon.h>
+
+#ifdef __linux__
+
+#include <algorithm>
+#include <charconv>
+
+static size_t parseCount(const char *text, size_t fallback) {
+    size_t value = 0;
+    std::string_view raw{text};
+    auto [end, error] = std::from_chars(raw.data(), raw.data() + raw.size(), value);
+    return error == std::errc{} && end == raw.data() + raw.size() && value > 0 ? value : fallback;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3 || argc > 5) {
+        std::cerr << std::format("Usage: {} <socket-path> <input-file-path> [connections] [requests-per-connection]\n",
+                                 fs::path{argv[0]}.filename().string());
+        return 1;
+    }
+
+    fs::path socketPath{argv[1]};
+    auto binaryData = readFile(argv[2]);
+    auto connections = argc > 3 ? parseCount(argv[3], 4) : 4;
+    auto requests = argc > 4 ? parseCount(argv[4], 10'000) : 10'000;
+
+    std::vector<std::vector<uint64_t>> latencies(connections);
+    std::atomic<size_t> failures{0};
+    std::atomic<size_t> stopped{0};
+
+    auto start = std::chrono::steady_clock::now();
+    {
+        std::vector<std::jthread> clients;
+        for (size_t c = 0; c < connections; c++) {
+            clients.emplace_back([&, c] {
+                DaemonClient client(socketPath);
+                latencies[c].reserve(requests);
+
+                for (size_t r = 0; r < requests; r++) {
+                    auto requestStart = std::chrono::steady_clock::now();
+                    auto response = client.disassemble(binaryData);
+                    if (!response.has_value()) {
+                        failures.fetch_add(1, std::memory_order_relaxed);
+                    } else if (response->status == ResponseStatus::DecodeStopped) {
+                        stopped.fetch_add(1, std::memory_order_relaxed);
+                    }
+                    latencies[c].push_back(nanosecondsSince(requestStart));
+                }
+            });
+        }
+    }
+    auto seconds = static_cast<double>(nanosecondsSince(start)) * 1e-9;
+
+    std::vector<uint64_t> all;
+    for (const auto &perConnection: latencies) {
+        all.insert(all.end(), perConnection.begin(), perConnection.end());
+    }
+    std::ranges::sort(all);
+
+    auto percentile = [&](double p) {
+        auto index = static_cast<size_t>(p * static_cast<double>(all.size() - 1));
+        return static_cast<double>(all[index]) * 1e-3;
+    };
+
+    std::cout << std::format("{} requests of {} bytes over {} connections, {} failed, {} stopped decoding early\n",
+                             all.size(), binaryData.size(), connections, failures.load(), stopped.load());
+    std::cout << std::format("p50 {:.1f} us, p99 {:.1f} us, max {:.1f} us, {:.0f} requests/s\n",
+                             percentile(0.50), percentile(0.99), percentile(1.0),
+                             static_cast<double>(all.size()) / seconds);
+
+    return failures.load() == 0 ? 0 : 1;
+}
+
+#else
+
+#include <iostream>
+
+int main() {
+    std::cerr << "The disassembly daemon is only supported on Linux\n";
+    return 1;
+}
+
+#endif
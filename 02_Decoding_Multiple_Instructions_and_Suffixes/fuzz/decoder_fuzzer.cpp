@@ -0,0 +1,108 @@
+// Differential fuzz target for the decoder, in the libFuzzer interface. Built as 02_decoder_fuzzer with
+// clang (-DENABLE_FUZZING=ON) and as the 02_fuzz_replay driver with any compiler.
+//
+// Every input is disassembled by the scalar batch kernel and checked three ways:
+//   - every other ISA variant the CPU supports must produce exactly the same run,
+//   - batch against single: decodeInstruction() + formatInstruction() one instruction at a time must give
+//     the same lengths, text and stop reason. Both share the decode and format code with the kernel, so
+//     this catches bugs in the batch loop (offsets, text space, where it stops), not in decoding itself,
+//   - the encoder round trip (round_trip.h) is the independent reference: each decoded instruction the
+//     decoder can print correctly must assemble back to an instruction with the same semantics.
+// Any disagreement aborts with a description, which libFuzzer turns into a saved crash input.
+//
+// 02_fuzz_replay --seed-corpus=<dir> listings/ writes the assembled listings as a starting corpus.
+
+#include <cstdio>
+#include <cstdlib>
+
+#include <decompile.h>
+#include <round_trip.h>
+
+[[noreturn]] static void reportMismatch(std::span<const uint8_t> input, size_t offset, const std::string &what) {
+    std::fprintf(stderr, "decoder mismatch at byte %zu: %s\ninput: %s\n", offset, what.c_str(),
+                 hexBytes(input).c_str());
+    std::abort();
+}
+
+// Variants other than scalar that this CPU can run
+static const std::vector<DecoderIsa> &vectorIsas() {
+    static const auto isas = [] {
+        std::vector<DecoderIsa> supported;
+        for (size_t i = 1; i < decoderIsaNames.size(); i++) {
+            if (isDecoderIsaSupported(static_cast<DecoderIsa>(i))) {
+                supported.push_back(static_cast<DecoderIsa>(i));
+            }
+        }
+        return supported;
+    }();
+    return isas;
+}
+
+extern "C" int LLVMFuzzerInitialize(int *, char ***) {
+    spdlog::set_level(spdlog::level::off);
+    return 0;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    std::span<const uint8_t> input{data, size};
+
+    // Every instruction takes at least one byte, so this much text always holds the whole input
+    std::string text(size * maxInstructionTextLength, '\0');
+    auto run = disassembleRun(DecoderIsa::Scalar, input, text);
+    text.resize(run.textLength);
+
+    std::string isaText;
+    for (auto isa: vectorIsas()) {
+        isaText.assign(size * maxInstructionTextLength, '\0');
+        auto isaRun = disassembleRun(isa, input, isaText);
+        isaText.resize(isaRun.textLength);
+
+        if (isaRun.bytesConsumed != run.bytesConsumed || isaRun.status != run.status || isaText != text) {
+            auto name = decoderIsaNames[static_cast<size_t>(isa)];
+            reportMismatch(input, std::min(isaRun.bytesConsumed, run.bytesConsumed),
+                           std::format("{} kernel differs from scalar", name));
+        }
+    }
+
+    size_t offset = 0;
+    size_t textOffset = 0;
+    size_t instructions = 0;
+    while (offset < size) {
+        DecodedInstruction instruction;
+        auto status = decodeInstruction(input.subspan(offset), instruction);
+        if (status != DecodeStatus::Ok) {
+            if (offset != run.bytesConsumed || status != run.status) {
+                reportMismatch(input, offset, "kernel stopped somewhere else than decodeInstruction()");
+            }
+            break;
+        }
+
+        if (instruction.length == 0 || instruction.length > size - offset) {
+            reportMismatch(input, offset, std::format("decoded length {} past the end", instruction.length));
+        }
+
+        auto line = formatInstruction(instruction);
+        if (std::string_view{text}.substr(textOffset, line.size()) != line) {
+            reportMismatch(input, offset, std::format("kernel text differs from `{}`", trim(line)));
+        }
+
+        if (isRoundTripSupported(instruction)) {
+            if (auto mismatch = roundTripMismatch(instruction)) {
+                reportMismatch(input, offset, mismatch.value());
+            }
+        }
+
+        offset += instruction.length;
+        textOffset += line.size();
+        instructions++;
+    }
+
+    if (offset == size && (run.bytesConsumed != size || run.status != DecodeStatus::Ok)) {
+        reportMismatch(input, offset, "kernel stopped before the end of valid input");
+    }
+    if (instructions != run.instructions || textOffset != text.size()) {
+        reportMismatch(input, offset, "kernel decoded a different number of instructions");
+    }
+
+    return 0;
+}
@@ -0,0 +1,146 @@
+// Standalone driver for decoder_fuzzer.cpp, for compilers without libFuzzer and for reproducing crashes.
+// Runs every given file (directories recursively, e.g. a libFuzzer corpus) through the fuzz target once,
+// then optionally a number of generated inputs, and reports the execution rate. NASM sources (.asm) are
+// assembled in process first, and --seed-corpus=<dir> saves those binaries as a corpus for libFuzzer.
+
+#include <chrono>
+#include <random>
+
+#include <decompile.h>
+#include <encode.h>
+#include <instruction_stream.h>
+
+extern "C" int LLVMFuzzerInitialize(int *argc, char ***argv);
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+struct ReplayOptions {
+    std::vector<fs::path> inputs;
+    std::optional<fs::path> seedCorpus; // where to write the assembled .asm inputs
+    uint64_t runs = 0;     // generated inputs after the given ones
+    size_t maxLength = 256;
+    uint32_t seed = 1;
+};
+
+static std::optional<ReplayOptions> parseReplayArgs(int argc, char *argv[]) {
+    ReplayOptions options;
+    for (int i = 1; i < argc; i++) {
+        std::string_view raw{argv[i]};
+
+        auto number = [&](std::string_view prefix) -> std::optional<uint64_t> {
+            auto value = parseNumber(raw.substr(prefix.size()));
+            return value.has_value() && value.value() >= 0 ? std::optional<uint64_t>{value.value()} : std::nullopt;
+        };
+
+        std::optional<uint64_t> value;
+        if (raw.starts_with("--runs=") && (value = number("--runs="))) {
+            options.runs = value.value();
+        } else if (raw.starts_with("--max-len=") && (value = number("--max-len=")) && value.value() > 0) {
+            options.maxLength = value.value();
+        } else if (raw.starts_with("--seed=") && (value = number("--seed="))) {
+            options.seed = static_cast<uint32_t>(value.value());
+        } else if (raw.starts_with("--seed-corpus=") && raw.size() > std::string_view{"--seed-corpus="}.size()) {
+            options.seedCorpus = fs::path{raw.substr(std::string_view{"--seed-corpus="}.size())};
+        } else if (raw.starts_with("--") || !fs::exists(raw)) {
+            std::cerr << std::format("Usage: {} [--runs=N] [--max-len=N] [--seed=N] [--seed-corpus=<dir>] "
+                                     "[<file-or-directory>...]\n",
+                                     fs::path{argv[0]}.filename().string());
+            return std::nullopt;
+        } else {
+            options.inputs.emplace_back(raw);
+        }
+    }
+    return options;
+}
+
+// Machine code of an input file, assembling NASM sources
+static std::optional<std::vector<uint8_t>> loadInput(const fs::path &file) {
+    if (file.extension() != ".asm") {
+        return readFile(file);
+    }
+
+    std::ifstream in(file);
+    std::string source{std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+    auto binary = assemble(source);
+    if (!binary.has_value()) {
+        std::cerr << std::format("Unable to assemble {}\n", file.string());
+    }
+    return binary;
+}
+
+// A stream from the shared test generator, cut to a random length so the last instruction is often
+// truncated, with a few bytes overwritten so unknown and unimplemented opcodes show up as well
+static void generateInput(std::mt19937 &random, size_t maxLength, std::vector<uint8_t> &input) {
+    auto length = random() % (maxLength + 1);
+    input.clear();
+    appendInstructionStream(random, length, input);
+    input.resize(length);
+
+    for (auto corrupted = input.empty() ? 0 : random() % 4; corrupted > 0; corrupted--) {
+        input[random() % input.size()] = static_cast<uint8_t>(random());
+    }
+}
+
+int main(int argc, char *argv[]) {
+    LLVMFuzzerInitialize(&argc, &argv);
+
+    auto options = parseReplayArgs(argc, argv);
+    if (!options.has_value()) {
+        return 1;
+    }
+
+    std::vector<fs::path> files;
+    for (const auto &input: options->inputs) {
+        if (fs::is_directory(input)) {
+            for (const auto &entry: fs::recursive_directory_iterator(input)) {
+                if (entry.is_regular_file()) {
+                    files.push_back(entry.path());
+                }
+            }
+        } else {
+            files.push_back(input);
+        }
+    }
+
+    uint64_t executions = 0;
+    uint64_t bytes = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    if (options->seedCorpus.has_value()) {
+        fs::create_directories(options->seedCorpus.value());
+    }
+
+    for (const auto &file: files) {
+        auto data = loadInput(file);
+        if (!data.has_value()) {
+            return 1;
+        }
+
+        if (options->seedCorpus.has_value() && file.extension() == ".asm") {
+            auto seedPath = options->seedCorpus.value() / file.filename().replace_extension(".bin");
+            std::ofstream(seedPath, std::ios::binary)
+                    .write(reinterpret_cast<const char *>(data->data()), static_cast<std::streamsize>(data->size()));
+        }
+
+        LLVMFuzzerTestOneInput(data->data(), data->size());
+        executions++;
+        bytes += data->size();
+    }
+
+    std::mt19937 random(options->seed);
+    std::vector<uint8_t> input;
+    input.reserve(options->maxLength);
+    for (uint64_t run = 0; run < options->runs; run++) {
+        generateInput(random, options->maxLength, input);
+        LLVMFuzzerTestOneInput(input.data(), input.size());
+        executions++;
+        bytes += input.size();
+    }
+
+    auto seconds = std::max(static_cast<double>(nanosecondsSince(start)) * 1e-9, 1e-9);
+    std::cout << std::format("replay: {} inputs ({} files, {} generated), {} bytes in {:.3f} s, "
+                             "{:.0f} exec/s, {:.2f} MB/s, {} decoder\n",
+                             executions, files.size(), options->runs, bytes, seconds,
+                             static_cast<double>(executions) / seconds, static_cast<double>(bytes) / seconds / 1e6,
+                             decoderIsaNames[static_cast<size_t>(activeDecoderIsa())]);
+    return 0;
+}
@@ -0,0 +1,221 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <charconv>
+#include <memory_resource>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <decompile.h>
+
+// Dense bitmap with one bit per byte of the image, O(1) set and test
+struct OffsetBitmap {
+    std::vector<uint64_t> words;
+
+    explicit OffsetBitmap(size_t size) : words((size + 63) / 64) {}
+
+    void set(size_t offset) {
+        words[offset >> 6] |= uint64_t{1} << (offset & 63);
+    }
+
+    bool test(size_t offset) const {
+        return (words[offset >> 6] >> (offset & 63)) & 1;
+    }
+
+    size_t count() const {
+        size_t total = 0;
+        for (auto word: words) {
+            total += std::popcount(word);
+        }
+        return total;
+    }
+};
+
+struct ControlFlow {
+    OffsetBitmap instructionStarts; // first byte of every instruction reached from an entry point
+    OffsetBitmap code;              // every byte covered by such an instruction, the rest is data
+    OffsetBitmap jumpTargets;       // offsets a jump, loop or call in the image transfers control to
+    OffsetBitmap labels;            // jump targets where the second pass starts a line, so they get a label
+
+    explicit ControlFlow(size_t size) : instructionStarts(size), code(size), jumpTargets(size), labels(size) {}
+};
+
+// Offset a jump, loop or call at offset transfers control to. Targets before the start of the image have none.
+static std::optional<size_t> branchTarget(const DecodedInstruction &instruction, size_t offset) {
+    if (!isRelativeBranch(instruction.kind)) {
+        return std::nullopt;
+    }
+
+    auto target = static_cast<int64_t>(offset) + instruction.length + static_cast<int16_t>(instruction.displacement);
+    if (target < 0) {
+        return std::nullopt;
+    }
+    return static_cast<size_t>(target);
+}
+
+// Recursive descent from the entry points. Every offset is decoded at most once, so the pass is linear in
+// the size of the image. The only allocations are the bitmaps and the worklist, which grows geometrically.
+static ControlFlow analyzeControlFlow(std::span<const uint8_t> binaryData, std::span<const size_t> entryPoints) {
+    ControlFlow flow(binaryData.size());
+
+    std::vector<size_t> worklist;
+    worklist.reserve(entryPoints.size() + 64);
+    for (auto entry: entryPoints) {
+        if (entry < binaryData.size()) {
+            worklist.push_back(entry);
+        }
+    }
+
+    while (!worklist.empty()) {
+        auto offset = worklist.back();
+        worklist.pop_back();
+
+        // Linear sweep until control leaves or we reach code that is already decoded
+        while (offset < binaryData.size() && !flow.instructionStarts.test(offset)) {
+            DecodedInstruction instruction;
+            if (decodeInstruction(binaryData.subspan(offset), instruction) != DecodeStatus::Ok) {
+                break;
+            }
+
+            flow.instructionStarts.set(offset);
+            for (size_t i = offset; i < offset + instruction.length; i++) {
+                flow.code.set(i);
+            }
+
+            if (auto target = branchTarget(instruction, offset); target.has_value() && *target < binaryData.size()) {
+                flow.jumpTargets.set(*target);
+                if (!flow.instructionStarts.test(*target)) {
+                    worklist.push_back(*target);
+                }
+            }
+
+            if (!fallsThrough(instruction.kind)) {
+                break;
+            }
+            offset += instruction.length;
+        }
+    }
+
+    // Same walk as the second pass. A target inside a printed instruction (code reached at overlapping
+    // offsets) has no line of its own, so branches to it keep the $-relative form instead of a label.
+    for (size_t i = 0; i < binaryData.size();) {
+        if (flow.jumpTargets.test(i)) {
+            flow.labels.set(i);
+        }
+
+        DecodedInstruction instruction;
+        if (flow.instructionStarts.test(i)) {
+            decodeInstruction(binaryData.subspan(i), instruction);
+            i += instruction.length;
+        } else {
+            i++;
+        }
+    }
+
+    return flow;
+}
+
+// label_xxxx with at least four hex digits, and enough for any offset in the image
+static size_t labelNameLength(size_t binarySize) {
+    size_t digits = 4;
+    while (digits < 16 && (binarySize >> (4 * digits)) != 0) {
+        digits++;
+    }
+    return std::string_view{"label_"}.size() + digits;
+}
+
+// Upper bound of the labelled output. A 2-byte branch naming a label, "jmp short label_xxxx\n", has more
+// text per byte than any instruction, and every label adds a "label_xxxx:\n" line.
+static size_t estimateLabelledDisassemblySize(size_t binarySize, const ControlFlow &flow) {
+    auto labelLength = labelNameLength(binarySize);
+    auto branchPerByte = (std::string_view{"jmp short \n"}.size() + labelLength + 1) / 2;
+    auto extraPerByte = branchPerByte > maxInstructionTextPerByte ? branchPerByte - maxInstructionTextPerByte : 0;
+    return estimateDisassemblySize(binarySize) + extraPerByte * binarySize + flow.labels.count() * (labelLength + 2);
+}
+
+// label_xxxx with at least four hex digits. Lines are appended in place rather than through std::format,
+// which costs more than decoding the instruction.
+template<typename Allocator>
+static void appendLabelName(std::basic_string<char, std::char_traits<char>, Allocator> &out, size_t offset) {
+    std::array<char, 16> digits;
+    auto end = std::to_chars(digits.data(), digits.data() + digits.size(), offset, 16).ptr;
+    auto count = static_cast<size_t>(end - digits.data());
+    out.append("label_");
+    out.append(count < 4 ? 4 - count : 0, '0');
+    out.append(digits.data(), count);
+}
+
+template<typename Allocator>
+static void appendByte(std::basic_string<char, std::char_traits<char>, Allocator> &out, uint8_t byte) {
+    std::array<char, 3> digits;
+    out.append(digits.data(), std::to_chars(digits.data(), digits.data() + digits.size(), byte).ptr);
+}
+
+// Second pass: emit NASM source with labels at jump targets and `db` for bytes that are not reachable code
+template<typename Allocator>
+static void decompileWithLabels(std::span<const uint8_t> binaryData, const ControlFlow &flow,
+                                std::basic_string<char, std::char_traits<char>, Allocator> &decodedInstructions) {
+    decodedInstructions.append("bits 16\n");
+
+    size_t i = 0;
+    while (i < binaryData.size()) {
+        if (flow.labels.test(i)) {
+            appendLabelName(decodedInstructions, i);
+            decodedInstructions.append(":\n");
+        }
+
+        if (flow.instructionStarts.test(i)) {
+            DecodedInstruction instruction;
+            decodeInstruction(binaryData.subspan(i), instruction);
+
+            auto target = branchTarget(instruction, i);
+            if (target.has_value() && *target < binaryData.size() && flow.labels.test(*target)) {
+                decodedInstructions.append(branchMnemonic(instruction));
+                decodedInstructions.push_back(' ');
+                appendLabelName(decodedInstructions, *target);
+                decodedInstructions.push_back('\n');
+            } else {
+                appendInstruction(decodedInstructions, instruction);
+            }
+            i += instruction.length;
+            continue;
+        }
+
+        // Data run, up to 16 bytes per line and never across a label or an instruction
+        decodedInstructions.append("db ");
+        appendByte(decodedInstructions, binaryData[i++]);
+        for (size_t n = 1; n < 16 && i < binaryData.size(); n++, i++) {
+            if (flow.labels.test(i) || flow.instructionStarts.test(i)) {
+                break;
+            }
+            decodedInstructions.append(", ");
+            appendByte(decodedInstructions, binaryData[i]);
+        }
+        decodedInstructions.push_back('\n');
+    }
+}
+
+static std::string decompileWithLabels(std::span<const uint8_t> binaryData, const ControlFlow &flow) {
+    std::string decodedInstructions;
+    decodedInstructions.reserve(estimateLabelledDisassemblySize(binaryData.size(), flow));
+    decompileWithLabels(binaryData, flow, decodedInstructions);
+    return decodedInstructions;
+}
+
+static std::string decompileWithLabels(std::span<const uint8_t> binaryData) {
+    constexpr size_t entryPoints[] = {0};
+    return decompileWithLabels(binaryData, analyzeControlFlow(binaryData, entryPoints));
+}
+
+// Size the resource with estimateLabelledDisassemblySize() for a single upstream allocation
+static std::pmr::string decompileWithLabels(std::span<const uint8_t> binaryData, const ControlFlow &flow,
+                                            std::pmr::memory_resource *resource) {
+    std::pmr::string decodedInstructions(resource);
+    decodedInstructions.reserve(estimateLabelledDisassemblySize(binaryData.size(), flow));
+    decompileWithLabels(binaryData, flow, decodedInstructions);
+    return decodedInstructions;
+}
@@ -0,0 +1,512 @@
+#pragma once
+
+// Long-lived disassembly service on a local UNIX domain socket (Linux only).
+//
+// Frames on the socket, integers in host byte order:
+//   request:  uint32 payload length | uint8 type | payload
+//             type 0: payload is machine code
+//             type 1: payload is uint64 offset | uint64 size | file path
+//   response: uint32 text length | uint8 status | disassembly or error message
+//             status 0: ok
+//             status 1: error, the text is the message
+//             status 2: decoding stopped early, the text is the disassembly up to the instruction that
+//                       failed to decode, ending with a `; decoding stopped at byte N` comment
+//
+// One thread runs an epoll loop that accepts connections and reads requests. Complete requests go to a
+// pool of workers which decode into per-connection buffers that are reused between requests, and the
+// loop writes the responses back. A connection has at most one request in flight.
+
+#ifdef __linux__
+
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <decompile.h>
+
+enum class RequestType : uint8_t {
+    Bytes = 0,
+    FileRange = 1,
+};
+
+enum class ResponseStatus : uint8_t {
+    Ok = 0,
+    Error = 1,
+    DecodeStopped = 2,
+};
+
+static constexpr size_t frameHeaderSize = 5;
+static constexpr uint32_t maxRequestSize = 64 * 1024 * 1024;
+
+static void writeFrameHeader(uint8_t *header, uint32_t length, uint8_t type) {
+    std::memcpy(header, &length, sizeof(length));
+    header[4] = type;
+}
+
+static uint32_t readFrameLength(const uint8_t *header) {
+    uint32_t length = 0;
+    std::memcpy(&length, header, sizeof(length));
+    return length;
+}
+
+static sockaddr_un unixSocketAddress(const fs::path &socketPath) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+
+    auto path = socketPath.string();
+    if (path.size() >= sizeof(address.sun_path)) {
+        throw std::runtime_error("Socket path is too long: " + path);
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return address;
+}
+
+class DisassemblyDaemon {
+public:
+    DisassemblyDaemon(const fs::path &socketPath, size_t workerCount) : socketPath_(socketPath) {
+        auto address = unixSocketAddress(socketPath);
+
+        // Replace a socket left behind by an earlier run, but never anything else
+        auto existing = fs::symlink_status(socketPath);
+        if (fs::is_socket(existing)) {
+            fs::remove(socketPath);
+        } else if (fs::exists(existing)) {
+            throw std::runtime_error("Unable to listen on " + socketPath.string() + ": not a socket");
+        }
+
+        listenFd_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (listenFd_ < 0 ||
+            ::bind(listenFd_, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+            ::listen(listenFd_, SOMAXCONN) != 0) {
+            closeDescriptors();
+            throw std::runtime_error("Unable to listen on " + socketPath.string() + ": " + std::strerror(errno));
+        }
+
+        epollFd_ = ::epoll_create1(EPOLL_CLOEXEC);
+        wakeFd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (epollFd_ < 0 || wakeFd_ < 0) {
+            closeDescriptors();
+            throw std::runtime_error(std::string("Unable to create the event loop: ") + std::strerror(errno));
+        }
+        watch(listenFd_, EPOLLIN, EPOLL_CTL_ADD);
+        watch(wakeFd_, EPOLLIN, EPOLL_CTL_ADD);
+
+        for (size_t i = 0; i < std::max<size_t>(1, workerCount); i++) {
+            workers_.emplace_back([this](std::stop_token stop) { workerLoop(stop); });
+        }
+    }
+
+    DisassemblyDaemon(const DisassemblyDaemon &) = delete;
+    DisassemblyDaemon &operator=(const DisassemblyDaemon &) = delete;
+
+    ~DisassemblyDaemon() {
+        for (auto &worker: workers_) {
+            worker.request_stop();
+        }
+        jobsReady_.notify_all();
+        workers_.clear();
+
+        closeDescriptors();
+        if (fs::is_socket(fs::symlink_status(socketPath_))) {
+            fs::remove(socketPath_);
+        }
+    }
+
+    // Serve until stop() is called
+    void run() {
+        std::array<epoll_event, 64> events{};
+        while (!stopping_.load(std::memory_order_acquire)) {
+            auto count = ::epoll_wait(epollFd_, events.data(), static_cast<int>(events.size()), -1);
+            if (count < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::runtime_error(std::string("epoll_wait failed: ") + std::strerror(errno));
+            }
+
+            for (int i = 0; i < count; i++) {
+                auto fd = events[i].data.fd;
+                if (fd == listenFd_) {
+                    acceptConnections();
+                } else if (fd == wakeFd_) {
+                    writeCompletedResponses();
+                } else if (auto it = connections_.find(fd); it != connections_.end()) {
+                    handleConnectionEvent(*it->second, events[i].events);
+                }
+            }
+        }
+    }
+
+    // Thread-safe
+    void stop() {
+        stopping_.store(true, std::memory_order_release);
+        wake();
+    }
+
+private:
+    struct Connection {
+        int fd = -1;
+        bool busy = false;   // a worker owns the buffers
+        bool closed = false; // peer went away while busy, release once the worker is done
+        bool peerDone = false; // peer shut down its sending side, close once the buffered requests are answered
+        std::vector<uint8_t> input;
+        std::vector<uint8_t> scratch;
+        std::string output;
+        size_t written = 0;
+    };
+
+    void watch(int fd, uint32_t events, int operation) {
+        epoll_event event{};
+        event.events = events;
+        event.data.fd = fd;
+        ::epoll_ctl(epollFd_, operation, fd, &event);
+    }
+
+    void wake() {
+        uint64_t one = 1;
+        [[maybe_unused]] auto written = ::write(wakeFd_, &one, sizeof(one));
+    }
+
+    void closeDescriptors() {
+        for (auto &[fd, connection]: connections_) {
+            ::close(fd);
+        }
+        connections_.clear();
+
+        for (auto fd: {listenFd_, epollFd_, wakeFd_}) {
+            if (fd >= 0) {
+                ::close(fd);
+            }
+        }
+        listenFd_ = epollFd_ = wakeFd_ = -1;
+    }
+
+    void acceptConnections() {
+        for (;;) {
+            auto fd = ::accept4(listenFd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) {
+                return;
+            }
+
+            auto connection = std::make_unique<Connection>();
+            connection->fd = fd;
+            connections_.emplace(fd, std::move(connection));
+            watch(fd, EPOLLIN, EPOLL_CTL_ADD);
+        }
+    }
+
+    void closeConnection(Connection &connection) {
+        watch(connection.fd, 0, EPOLL_CTL_DEL);
+        if (connection.busy) {
+            connection.closed = true;
+            return;
+        }
+
+        auto fd = connection.fd;
+        ::close(fd);
+        connections_.erase(fd);
+    }
+
+    void handleConnectionEvent(Connection &connection, uint32_t events) {
+        if (events & (EPOLLHUP | EPOLLERR)) {
+            return closeConnection(connection);
+        }
+
+        if (events & EPOLLOUT) {
+            return continueWriting(connection);
+        }
+
+        std::array<uint8_t, 64 * 1024> buffer;
+        for (;;) {
+            auto received = ::recv(connection.fd, buffer.data(), buffer.size(), 0);
+            if (received > 0) {
+                connection.input.insert(connection.input.end(), buffer.begin(), buffer.begin() + received);
+                continue;
+            }
+            if (received == 0) {
+                connection.peerDone = true;
+            } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                return closeConnection(connection);
+            }
+            break;
+        }
+
+        dispatchIfComplete(connection);
+    }
+
+    // Hands the next complete request to a worker. Once the peer is done sending and no complete request
+    // is left, the connection is closed.
+    void dispatchIfComplete(Connection &connection) {
+        auto complete = false;
+        if (connection.input.size() >= frameHeaderSize) {
+            auto length = readFrameLength(connection.input.data());
+            if (length > maxRequestSize) {
+                spdlog::error("Request of {} bytes exceeds the limit", length);
+                return closeConnection(connection);
+            }
+            complete = connection.input.size() >= frameHeaderSize + length;
+        }
+
+        if (!complete) {
+            if (connection.peerDone) {
+                closeConnection(connection);
+            }
+            return;
+        }
+
+        // Stop reading until the response is written, the worker owns the buffers now
+        connection.busy = true;
+        watch(connection.fd, 0, EPOLL_CTL_MOD);
+        {
+            std::lock_guard lock(mutex_);
+            jobs_.push_back(&connection);
+        }
+        jobsReady_.notify_one();
+    }
+
+    void writeCompletedResponses() {
+        uint64_t counter = 0;
+        [[maybe_unused]] auto drained = ::read(wakeFd_, &counter, sizeof(counter));
+
+        std::vector<Connection *> completed;
+        {
+            std::lock_guard lock(mutex_);
+            completed.swap(completed_);
+        }
+
+        for (auto *connection: completed) {
+            connection->busy = false;
+            if (connection->closed) {
+                closeConnection(*connection);
+                continue;
+            }
+            continueWriting(*connection);
+        }
+    }
+
+    void continueWriting(Connection &connection) {
+        while (connection.written < connection.output.size()) {
+            auto sent = ::send(connection.fd, connection.output.data() + connection.written,
+                               connection.output.size() - connection.written, MSG_NOSIGNAL);
+            if (sent < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    return watch(connection.fd, EPOLLOUT, EPOLL_CTL_MOD);
+                }
+                return closeConnection(connection);
+            }
+            connection.written += static_cast<size_t>(sent);
+        }
+
+        connection.output.clear();
+        connection.written = 0;
+        watch(connection.fd, connection.peerDone ? 0 : EPOLLIN, EPOLL_CTL_MOD);
+
+        // The client may have pipelined the next request already
+        dispatchIfComplete(connection);
+    }
+
+    void workerLoop(std::stop_token stop) {
+        for (;;) {
+            Connection *connection = nullptr;
+            {
+                std::unique_lock lock(mutex_);
+                if (!jobsReady_.wait(lock, stop, [&] { return !jobs_.empty(); })) {
+                    return;
+                }
+                connection = jobs_.front();
+                jobs_.pop_front();
+            }
+
+            processRequest(*connection);
+
+            {
+                std::lock_guard lock(mutex_);
+                completed_.push_back(connection);
+            }
+            wake();
+        }
+    }
+
+    static void processRequest(Connection &connection) {
+        auto length = readFrameLength(connection.input.data());
+        auto type = static_cast<RequestType>(connection.input[4]);
+        auto payload = std::span<const uint8_t>{connection.input}.subspan(frameHeaderSize, length);
+
+        auto &output = connection.output;
+        output.assign(frameHeaderSize, '\0');
+
+        auto status = ResponseStatus::Ok;
+        auto respond = [&](std::span<const uint8_t> bytes) {
+            auto decoded = decompile(bytes, output);
+            if (decoded < bytes.size()) {
+                status = ResponseStatus::DecodeStopped;
+                std::format_to(std::back_inserter(output), "; decoding stopped at byte {}\n", decoded);
+            }
+        };
+
+        if (type == RequestType::Bytes) {
+            respond(payload);
+        } else if (type == RequestType::FileRange && payload.size() > 2 * sizeof(uint64_t)) {
+            uint64_t offset = 0;
+            uint64_t size = 0;
+            std::memcpy(&offset, payload.data(), sizeof(offset));
+            std::memcpy(&size, payload.data() + sizeof(offset), sizeof(size));
+            auto path = std::string_view{reinterpret_cast<const char *>(payload.data()) + 2 * sizeof(uint64_t),
+                                         payload.size() - 2 * sizeof(uint64_t)};
+
+            if (readFileRange(fs::path{path}, offset, size, connection.scratch)) {
+                respond(connection.scratch);
+            } else {
+                status = ResponseStatus::Error;
+                output.append(std::format("Unable to read {} bytes at {} from {}", size, offset, path));
+            }
+        } else {
+            status = ResponseStatus::Error;
+            output.append("Malformed request");
+        }
+
+        writeFrameHeader(reinterpret_cast<uint8_t *>(output.data()),
+                         static_cast<uint32_t>(output.size() - frameHeaderSize), static_cast<uint8_t>(status));
+
+        // Keep the capacity, drop only the request that was served
+        connection.input.erase(connection.input.begin(),
+                               connection.input.begin() + static_cast<ptrdiff_t>(frameHeaderSize + length));
+    }
+
+    static bool readFileRange(const fs::path &path, uint64_t offset, uint64_t size, std::vector<uint8_t> &bytes) {
+        std::error_code error;
+        auto fileSize = fs::file_size(path, error);
+        if (error || offset > fileSize || size > fileSize - offset || size > maxRequestSize) {
+            return false;
+        }
+
+        std::ifstream in(path, std::ios::binary);
+        in.seekg(static_cast<std::streamoff>(offset));
+        bytes.resize(size);
+        in.read(reinterpret_cast<char *>(bytes.data()), static_cast<std::streamsize>(size));
+        return static_cast<bool>(in);
+    }
+
+    fs::path socketPath_;
+    int listenFd_ = -1;
+    int epollFd_ = -1;
+    int wakeFd_ = -1;
+    std::atomic<bool> stopping_{false};
+
+    std::unordered_map<int, std::unique_ptr<Connection>> connections_;
+
+    std::mutex mutex_;
+    std::condition_variable_any jobsReady_;
+    std::deque<Connection *> jobs_;
+    std::vector<Connection *> completed_;
+    std::vector<std::jthread> workers_;
+};
+
+struct DaemonResponse {
+    ResponseStatus status = ResponseStatus::Ok; // Ok or DecodeStopped
+    std::string_view text;                      // valid until the next request
+};
+
+// Blocking client for the daemon, one request at a time. Buffers are reused between requests.
+class DaemonClient {
+public:
+    explicit DaemonClient(const fs::path &socketPath) {
+        auto address = unixSocketAddress(socketPath);
+        fd_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd_ < 0 || ::connect(fd_, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0) {
+            if (fd_ >= 0) {
+                ::close(fd_);
+            }
+            throw std::runtime_error("Unable to connect to " + socketPath.string() + ": " + std::strerror(errno));
+        }
+    }
+
+    DaemonClient(const DaemonClient &) = delete;
+    DaemonClient &operator=(const DaemonClient &) = delete;
+
+    ~DaemonClient() {
+        ::close(fd_);
+    }
+
+    // Disassembly, possibly cut short by an undecodable instruction (see the status).
+    // std::nullopt on a transport failure or an error response.
+    std::optional<DaemonResponse> disassemble(std::span<const uint8_t> bytes) {
+        return request(RequestType::Bytes, bytes);
+    }
+
+    std::optional<DaemonResponse> disassembleFile(const fs::path &path, uint64_t offset, uint64_t size) {
+        auto pathString = path.string();
+        payload_.resize(2 * sizeof(uint64_t) + pathString.size());
+        std::memcpy(payload_.data(), &offset, sizeof(offset));
+        std::memcpy(payload_.data() + sizeof(offset), &size, sizeof(size));
+        std::memcpy(payload_.data() + 2 * sizeof(uint64_t), pathString.data(), pathString.size());
+        return request(RequestType::FileRange, payload_);
+    }
+
+    const std::string &lastError() const {
+        return error_;
+    }
+
+private:
+    std::optional<DaemonResponse> request(RequestType type, std::span<const uint8_t> payload) {
+        std::array<uint8_t, frameHeaderSize> header{};
+        writeFrameHeader(header.data(), static_cast<uint32_t>(payload.size()), static_cast<uint8_t>(type));
+        if (!sendAll(header) || !sendAll(payload) || !receiveAll(header)) {
+            error_ = std::string("Connection failed: ") + std::strerror(errno);
+            return std::nullopt;
+        }
+
+        response_.resize(readFrameLength(header.data()));
+        if (!receiveAll(std::span{reinterpret_cast<uint8_t *>(response_.data()), response_.size()})) {
+            error_ = std::string("Connection failed: ") + std::strerror(errno);
+            return std::nullopt;
+        }
+
+        auto status = static_cast<ResponseStatus>(header[4]);
+        if (status != ResponseStatus::Ok && status != ResponseStatus::DecodeStopped) {
+            error_ = response_;
+            return std::nullopt;
+        }
+        return DaemonResponse{.status = status, .text = response_};
+    }
+
+    bool sendAll(std::span<const uint8_t> bytes) {
+        while (!bytes.empty()) {
+            auto sent = ::send(fd_, bytes.data(), bytes.size(), MSG_NOSIGNAL);
+            if (sent <= 0) {
+                return false;
+            }
+            bytes = bytes.subspan(static_cast<size_t>(sent));
+        }
+        return true;
+    }
+
+    bool receiveAll(std::span<uint8_t> bytes) {
+        while (!bytes.empty()) {
+            auto received = ::recv(fd_, bytes.data(), bytes.size(), 0);
+            if (received <= 0) {
+                return false;
+            }
+            bytes = bytes.subspan(static_cast<size_t>(received));
+        }
+        return true;
+    }
+
+    int fd_ = -1;
+    std::vector<uint8_t> payload_;
+    std::string response_;
+    std::string error_;
+};
+
+#endif
@@ -10,9 +10,14 @@
 #include <optional>
 #include <format>
 #include <ranges>
+#include <cassert>
+#include <memory_resource>
 
 #include <spdlog/spdlog.h>
 
+#include <decoder.h>
+#include <metrics.h>
+
 namespace fs = std::filesystem;
 
 template<std::ranges::range R>
@@ -34,229 +39,187 @@ static std::vector<uint8_t> readFile(const std::filesystem::path &p) {
     return buf;
 }
 
-static std::optional<fs::path> parseArgs(int argc, char *argv[]) {
-    if (argc != 2) {
-        spdlog::error("Usage: {} <input-file-path>", fs::path{argv[0]}.filename().string());
-        return std::nullopt;
+struct Options {
+    std::vector<fs::path> inputs;
+    bool stats = false; // decode only, print the instruction mix instead of the disassembly
+    bool json = false;  // print statistics as JSON instead of a table
+    bool labels = false; // follow control flow from offset 0, emit labels and `db` for unreachable bytes
+    bool pipeline = false; // stream through reader/decoder/writer threads and report their overlap to stderr
+    std::optional<MetricsFormat> metrics; // print decoder metrics to stderr when done
+    std::optional<fs::path> daemonSocket; // serve requests on this UNIX domain socket instead of reading inputs
+    std::optional<DecoderIsa> isa; // decoder variant to use instead of the best one the CPU supports
+};
+
+static std::optional<Options> parseArgs(int argc, char *argv[]) {
+    auto printUsage = [&] {
+        auto name = fs::path{argv[0]}.filename().string();
+        std::cerr << std::format("Usage: {} [--stats [--json]] [--labels | --pipeline] [--metrics=prometheus|json] "
+                                 "[--isa=scalar|sse4.2|avx2|avx512] <input-file-path>...\n",
+                                 name);
+        std::cerr << std::format("       {} [--isa=...] --daemon=<socket-path>\n", name);
+    };
+
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        std::string_view raw{argv[i]};
+
+        if (raw == "--stats") {
+            options.stats = true;
+        } else if (raw == "--json") {
+            options.json = true;
+        } else if (raw == "--labels") {
+            options.labels = true;
+        } else if (raw == "--pipeline") {
+            options.pipeline = true;
+        } else if (raw == "--metrics=prometheus") {
+            options.metrics = MetricsFormat::Prometheus;
+        } else if (raw == "--metrics=json") {
+            options.metrics = MetricsFormat::Json;
+        } else if (raw.starts_with("--daemon=")) {
+            options.daemonSocket = fs::path{raw.substr(std::string_view{"--daemon="}.size())};
+        } else if (raw.starts_with("--isa=")) {
+            options.isa = parseDecoderIsa(raw.substr(std::string_view{"--isa="}.size()));
+            if (!options.isa.has_value()) {
+                std::cerr << std::format("Error: unknown decoder variant {}\n", raw);
+                printUsage();
+                return std::nullopt;
+            }
+        } else if (raw.starts_with("--")) {
+            std::cerr << std::format("Error: unknown option {}\n", raw);
+            printUsage();
+            return std::nullopt;
+        } else {
+            options.inputs.emplace_back(raw);
+        }
     }
 
-    std::string_view raw{argv[1]};
-    fs::path input_path{raw};
+    if (options.daemonSocket.has_value()) {
+        if (!options.inputs.empty() || options.daemonSocket->empty()) {
+            printUsage();
+            return std::nullopt;
+        }
+        return options;
+    }
 
-    if (!fs::exists(input_path) || !fs::is_regular_file(input_path)) {
-        spdlog::error("Error: {} is not a regular file", input_path.string());
+    // Only statistics can be accumulated over several files
+    if (options.inputs.empty() || (!options.stats && options.inputs.size() != 1) || (options.json && !options.stats) ||
+        (options.labels && options.pipeline)) {
+        printUsage();
         return std::nullopt;
     }
 
-    return input_path;
-}
-
-static std::string decodeRegister(uint8_t bits, bool W) {
-    assert((bits >> 3) == 0);
-
-    switch (bits) {
-        case 0b000:
-            return W ? "ax" : "al";
-        case 0b001:
-            return W ? "cx" : "cl";
-        case 0b010:
-            return W ? "dx" : "dl";
-        case 0b011:
-            return W ? "bx" : "bl";
-        case 0b100:
-            return W ? "sp" : "ah";
-        case 0b101:
-            return W ? "bp" : "ch";
-        case 0b110:
-            return W ? "si" : "dh";
-        case 0b111:
-            return W ? "di" : "bh";
-        default:
-            spdlog::error("Failed to decode register {:08b} with W flag = {}", bits, W ? "true" : "false");
-            assert(false && "Failed to decode register");
+    for (const auto &input_path: options.inputs) {
+        if (!fs::exists(input_path) || !fs::is_regular_file(input_path)) {
+            std::cerr << std::format("Error: {} is not a regular file\n", input_path.string());
+            return std::nullopt;
+        }
     }
-}
 
-static std::string memoryModeEffectiveAddress(uint8_t rm) {
-    assert((rm >> 3) == 0);
+    return options;
+}
 
-    switch (rm) {
-        case 0b000:
-            return "[bx + si]";
-        case 0b001:
-            return "[bx + di]";
-        case 0b010:
-            return "[bp + si]";
-        case 0b011:
-            return "[bp + di]";
-        case 0b100:
-            return "[si]";
-        case 0b101:
-            return "[di]";
-        case 0b110:
-            return std::to_string(rm);
-        case 0b111:
-            return "[bx]";
+static void reportDecodeFailure(DecodeStatus status, const DecodedInstruction &instruction, size_t offset,
+                                DecoderCounters &counters) {
+    switch (status) {
+        case DecodeStatus::Ok:
+            break;
+        case DecodeStatus::Truncated:
+            counters.truncatedInstructions++;
+            spdlog::error("Truncated instruction {:08b} at byte {}", instruction.opcode, offset);
+            break;
+        case DecodeStatus::NotImplemented:
+            counters.notImplemented++;
+            switch (instruction.kind) {
+                case InstructionKind::MovImmediateToRegisterMemory:
+                    spdlog::error("Immediate to register/memory MOV is not implemented");
+                    break;
+                case InstructionKind::MovMemoryToAccumulator:
+                    spdlog::error("Memory to accumulator MOV is not implemented");
+                    break;
+                case InstructionKind::MovAccumulatorToMemory:
+                    spdlog::error("Accumulator to memory MOV is not implemented");
+                    break;
+                default:
+                    spdlog::error("Instruction {:08b} is not implemented", instruction.opcode);
+                    break;
+            }
+            break;
+        case DecodeStatus::Unknown:
+            counters.unknownOpcodes++;
+            spdlog::error("Failed to recognize instruction: {:08b}", instruction.opcode);
+            break;
     }
-
-    assert(false);
 }
 
-static std::string memoryModeEffectiveAddressWithDisplacement(uint8_t rm, uint16_t displacement) {
-    assert((rm >> 3) == 0);
-
-    switch (rm) {
-        case 0b000:
-            return displacement == 0 ? "[bx + si]" : std::format("[bx + si + {}]", displacement);
-        case 0b001:
-            return displacement == 0 ? "[bx + di]" : std::format("[bx + di + {}]", displacement);
-        case 0b010:
-            return displacement == 0 ? "[bp + si]" : std::format("[bp + si + {}]", displacement);
-        case 0b011:
-            return displacement == 0 ? "[bp + di]" : std::format("[bp + di + {}]", displacement);
-        case 0b100:
-            return displacement == 0 ? "[si]" : std::format("[si + {}]", displacement);
-        case 0b101:
-            return displacement == 0 ? "[di]" : std::format("[di + {}]", displacement);
-        case 0b110:
-            return displacement == 0 ? "[bp]" : std::format("[bp + {}]", displacement);
-        case 0b111:
-            return displacement == 0 ? "[bx]" : std::format("[bx + {}]", displacement);
-    }
+// Upper bound of the output size, so reserving it once is enough. The kernel only starts an instruction
+// with maxInstructionTextLength characters of space left, which the last instruction may need on top.
+static size_t estimateDisassemblySize(size_t binarySize) {
+    return std::string_view{"bits 16\n"}.size() + maxInstructionTextPerByte * binarySize + maxInstructionTextLength;
+}
 
-    assert(false);
+// Decodes as much of binaryData as fits and prints it straight into the spare capacity of out. The
+// capacity is not zero-filled first, so pages of a generous reservation that are never written stay untouched.
+template<typename Allocator>
+static DisassemblyRun appendDisassemblyRun(std::basic_string<char, std::char_traits<char>, Allocator> &out,
+                                           std::span<const uint8_t> binaryData) {
+    constexpr size_t minimumRunText = 4096;
+
+    auto textStart = out.size();
+    DisassemblyRun run;
+    out.resize_and_overwrite(std::max(out.capacity(), textStart + minimumRunText), [&](char *text, size_t size) {
+        run = disassembleRun(binaryData, std::span{text + textStart, size - textStart});
+        return textStart + run.textLength;
+    });
+    return run;
 }
 
-// Follow Intel-8086 user manual, page 261, section 4-18
-static std::string decompile(const std::vector<uint8_t> &binaryData) {
+// Appends the disassembly to decodedInstructions, so callers can reuse its capacity between runs.
+// Returns the number of bytes decoded, less than the input if an instruction failed to decode.
+template<typename Allocator>
+static size_t decompile(std::span<const uint8_t> binaryData,
+                      std::basic_string<char, std::char_traits<char>, Allocator> &decodedInstructions) {
     spdlog::debug("Decompiling binary: {} bytes", binaryData.size());
 
-    std::string decodedInstructions;
-    decodedInstructions.append("bits 16\n");
-
-    for (int64_t i = 0; i < static_cast<int64_t>(binaryData.size()); i++) {
-        auto byte = binaryData[i];
-        spdlog::debug("byte {}: {:08b}", i, byte);
-
-        if ((byte & ~0b11) == 0b10001000) {
-            spdlog::debug("MOV Register/memory to/from register");
-
-            auto D = (byte >> 1) & 1;
-            auto W = byte & 1;
-            spdlog::debug("mov (D={} W={})", D, W);
-            decodedInstructions.append("mov ");
-
-            // Read next byte
-            byte = binaryData[++i];
-            spdlog::debug("byte {}: {:08b}", i, byte);
-
-            auto mod = (byte >> 6);
-            auto reg = (byte >> 3) & 0b111;
-            auto rm = byte & 0b111;
-            spdlog::debug("mod={:02b}, reg={:03b}, rm={:03b}", mod, reg, rm);
+    auto start = std::chrono::steady_clock::now();
+    DecoderCounters counters;
+    counters.runs = 1;
 
-            if (mod == 0b11) {
-                spdlog::debug("Register mode, no displacement");
-                auto reg0 = decodeRegister(reg, W);
-                auto reg1 = decodeRegister(rm, W);
-
-                if (D == 1) {
-                    std::swap(reg0, reg1);
-                }
-
-                auto decoded = std::format("{}, {}\n", reg1, reg0);
-                spdlog::debug("{}", decoded);
-                decodedInstructions.append(decoded);
-            } else if (mod == 0b00) {
-                spdlog::debug("Memory mode, no displacement*");
-
-                auto reg0 = decodeRegister(reg, W);
-                auto src = memoryModeEffectiveAddress(rm);
-
-                if (D == 0) {
-                    std::swap(reg0, src);
-                }
-
-                spdlog::debug(std::format("{}, {}\n", reg0, src));
-                decodedInstructions.append(std::format("{}, {}\n", reg0, src));
-            } else if (mod == 0b01) {
-                spdlog::debug("Memory mode with 8bit displacement");
-
-                auto reg0 = decodeRegister(reg, W);
-
-                auto displacement = binaryData[++i];
-                spdlog::debug("byte {}: {:08b}", i, displacement);
-                auto src = memoryModeEffectiveAddressWithDisplacement(rm, displacement);
-
-                if (D == 0) {
-                    std::swap(reg0, src);
-                }
-
-                spdlog::debug(std::format("{}, {}\n", reg0, src));
-                decodedInstructions.append(std::format("{}, {}\n", reg0, src));
-            } else { // mod == 0b10
-                spdlog::debug("Memory mode with 16bit displacement");
-
-                auto reg0 = decodeRegister(reg, W);
-
-                auto lo = binaryData[++i];
-                spdlog::debug("byte {}: {:08b}", i, lo);
-                auto hi = binaryData[++i];
-                spdlog::debug("byte {}: {:08b}", i, hi);
-
-                auto displacement = (uint16_t{hi} << 8) | uint16_t{lo};
-                spdlog::debug("uint16 displacement {}", displacement);
-                auto src = memoryModeEffectiveAddressWithDisplacement(rm, displacement);
-
-                if (D == 0) {
-                    std::swap(reg0, src);
-                }
-
-                spdlog::debug(std::format("{}, {}\n", reg0, src));
-                decodedInstructions.append(std::format("{}, {}\n", reg0, src));
-            }
-        } else if ((byte & ~0b1) == 0b11000110) {
-            spdlog::error("Immediate to register/memory MOV is not implemented");
-            break;
-        } else if ((byte & ~0b1111) == 0b10110000) {
-            spdlog::debug("MOV Immediate to register");
-
-            auto W = (byte >> 3) & 1;
-            auto reg = (byte & 0b111);
-            auto reg0 = decodeRegister(reg, W);
-            spdlog::debug("mov (W={}, reg={})", W, reg0);
-            decodedInstructions.append(std::format("mov {}, ", reg0));
+    decodedInstructions.append("bits 16\n");
 
-            // Read next byte
-            byte = binaryData[++i];
-            spdlog::debug("byte {}: {:08b}", i, byte);
-            if (W == 0) {
-                spdlog::debug("constant uint8 value {}", byte);
-                decodedInstructions.append(std::format("{}\n", byte));
-                continue;
-            }
+    size_t i = 0;
+    while (i < binaryData.size()) {
+        auto run = appendDisassemblyRun(decodedInstructions, binaryData.subspan(i));
+        spdlog::debug("byte {}: {} instructions in {} bytes", i, run.instructions, run.bytesConsumed);
 
-            // Read high part of uint16 constant
-            auto lo = byte;
-            auto hi = binaryData[++i];
-            spdlog::debug("byte {}: {:08b}", i, hi);
+        i += run.bytesConsumed;
+        counters.instructionsDecoded += run.instructions;
 
-            auto constant = (uint16_t{hi} << 8) | uint16_t{lo};
-            spdlog::debug("constant uint16 value {}", constant);
-            decodedInstructions.append(std::format("{}\n", constant));
-        } else if ((byte & ~0b1) == 0b10100000) {
-            spdlog::error("Memory to accumulator MOV is not implemented");
-            break;
-        } else if ((byte & ~0b1) == 0b10100010) {
-            spdlog::error("Accumulator to memory MOV is not implemented");
-            break;
-        } else {
-            spdlog::error("Failed to recognize instruction: {:08b}", byte);
+        if (run.status != DecodeStatus::Ok) {
+            DecodedInstruction instruction;
+            decodeInstruction(binaryData.subspan(i), instruction);
+            reportDecodeFailure(run.status, instruction, i, counters);
             break;
         }
+    }
 
+    counters.bytesConsumed = i;
+    counters.stageNanoseconds[static_cast<size_t>(DecoderStage::Decode)] = nanosecondsSince(start);
+    decoderMetrics().add(counters);
+    return i;
+}
 
-    }
+static std::string decompile(std::span<const uint8_t> binaryData) {
+    std::string decodedInstructions;
+    decodedInstructions.reserve(estimateDisassemblySize(binaryData.size()));
+    decompile(binaryData, decodedInstructions);
+    return decodedInstructions;
+}
 
+// All memory of the run comes from the given resource, typically a std::pmr::monotonic_buffer_resource
+// sized with estimateDisassemblySize() and released at once when the run is done
+static std::pmr::string decompile(std::span<const uint8_t> binaryData, std::pmr::memory_resource *resource) {
+    std::pmr::string decodedInstructions(resource);
+    decodedInstructions.reserve(estimateDisassemblySize(binaryData.size()));
+    decompile(binaryData, decodedInstructions);
     return decodedInstructions;
-}
\ No newline at end of file
+}
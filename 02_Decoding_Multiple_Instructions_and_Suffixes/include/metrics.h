@@ -0,0 +1,131 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <format>
+#include <string>
+#include <string_view>
+
+enum class DecoderStage : uint8_t {
+    Read,
+    Decode,
+    Write,
+    Count,
+};
+
+static constexpr std::array<std::string_view, static_cast<size_t>(DecoderStage::Count)> decoderStageNames = {
+        "read", "decode", "write",
+};
+
+enum class MetricsFormat : uint8_t {
+    Prometheus,
+    Json,
+};
+
+// Plain counters. The decoder accumulates a batch of these locally and publishes it once per run,
+// so the hot loop never touches shared memory.
+struct DecoderCounters {
+    uint64_t runs = 0;
+    uint64_t bytesConsumed = 0;
+    uint64_t instructionsDecoded = 0;
+    uint64_t unknownOpcodes = 0;
+    uint64_t notImplemented = 0;
+    uint64_t truncatedInstructions = 0;
+    std::array<uint64_t, static_cast<size_t>(DecoderStage::Count)> stageNanoseconds{};
+};
+
+struct DecoderMetrics {
+    std::atomic<uint64_t> runs{0};
+    std::atomic<uint64_t> bytesConsumed{0};
+    std::atomic<uint64_t> instructionsDecoded{0};
+    std::atomic<uint64_t> unknownOpcodes{0};
+    std::atomic<uint64_t> notImplemented{0};
+    std::atomic<uint64_t> truncatedInstructions{0};
+    std::array<std::atomic<uint64_t>, static_cast<size_t>(DecoderStage::Count)> stageNanoseconds{};
+
+    void add(const DecoderCounters &batch) {
+        // Counters are independent of each other, no ordering is needed
+        runs.fetch_add(batch.runs, std::memory_order_relaxed);
+        bytesConsumed.fetch_add(batch.bytesConsumed, std::memory_order_relaxed);
+        instructionsDecoded.fetch_add(batch.instructionsDecoded, std::memory_order_relaxed);
+        unknownOpcodes.fetch_add(batch.unknownOpcodes, std::memory_order_relaxed);
+        notImplemented.fetch_add(batch.notImplemented, std::memory_order_relaxed);
+        truncatedInstructions.fetch_add(batch.truncatedInstructions, std::memory_order_relaxed);
+        for (size_t i = 0; i < stageNanoseconds.size(); i++) {
+            stageNanoseconds[i].fetch_add(batch.stageNanoseconds[i], std::memory_order_relaxed);
+        }
+    }
+
+    DecoderCounters snapshot() const {
+        DecoderCounters counters;
+        counters.runs = runs.load(std::memory_order_relaxed);
+        counters.bytesConsumed = bytesConsumed.load(std::memory_order_relaxed);
+        counters.instructionsDecoded = instructionsDecoded.load(std::memory_order_relaxed);
+        counters.unknownOpcodes = unknownOpcodes.load(std::memory_order_relaxed);
+        counters.notImplemented = notImplemented.load(std::memory_order_relaxed);
+        counters.truncatedInstructions = truncatedInstructions.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < stageNanoseconds.size(); i++) {
+            counters.stageNanoseconds[i] = stageNanoseconds[i].load(std::memory_order_relaxed);
+        }
+        return counters;
+    }
+};
+
+// Process-wide instance. Unlike the rest of the header this is inline, not static,
+// so every translation unit reports into the same counters.
+inline DecoderMetrics &decoderMetrics() {
+    static DecoderMetrics metrics;
+    return metrics;
+}
+
+static uint64_t nanosecondsSince(std::chrono::steady_clock::time_point start) {
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+}
+
+static std::string formatMetricsPrometheus(const DecoderCounters &counters) {
+    std::string out;
+    auto counter = [&](std::string_view name, std::string_view help, uint64_t value) {
+        out.append(std::format("# HELP {} {}\n# TYPE {} counter\n{} {}\n", name, help, name, name, value));
+    };
+
+    counter("decoder_runs_total", "Number of decompile() calls.", counters.runs);
+    counter("decoder_bytes_consumed_total", "Bytes consumed by the decoder.", counters.bytesConsumed);
+    counter("decoder_instructions_decoded_total", "Instructions decoded.", counters.instructionsDecoded);
+    counter("decoder_unknown_opcodes_total", "Runs stopped on an unrecognized opcode.", counters.unknownOpcodes);
+    counter("decoder_not_implemented_total", "Runs stopped on an opcode without decoding support.",
+            counters.notImplemented);
+    counter("decoder_truncated_instructions_total", "Runs stopped on an instruction cut short by the end of input.",
+            counters.truncatedInstructions);
+
+    out.append("# HELP decoder_stage_seconds_total Time spent per stage.\n");
+    out.append("# TYPE decoder_stage_seconds_total counter\n");
+    for (size_t i = 0; i < decoderStageNames.size(); i++) {
+        out.append(std::format("decoder_stage_seconds_total{{stage=\"{}\"}} {:.9f}\n",
+                               decoderStageNames[i], static_cast<double>(counters.stageNanoseconds[i]) * 1e-9));
+    }
+
+    return out;
+}
+
+static std::string formatMetricsJson(const DecoderCounters &counters) {
+    std::string out;
+    out.append(std::format(R"({{"runs":{},"bytesConsumed":{},"instructionsDecoded":{},)",
+                           counters.runs, counters.bytesConsumed, counters.instructionsDecoded));
+    out.append(std::format(R"("unknownOpcodes":{},"notImplemented":{},"truncatedInstructions":{},)",
+                           counters.unknownOpcodes, counters.notImplemented, counters.truncatedInstructions));
+
+    out.append(R"("stageNanoseconds":{)");
+    for (size_t i = 0; i < decoderStageNames.size(); i++) {
+        out.append(std::format(R"({}"{}":{})", i == 0 ? "" : ",", decoderStageNames[i], counters.stageNanoseconds[i]));
+    }
+    out.append("}}\n");
+
+    return out;
+}
+
+static std::string formatMetrics(const DecoderCounters &counters, MetricsFormat format) {
+    return format == MetricsFormat::Json ? formatMetricsJson(counters) : formatMetricsPrometheus(counters);
+}
@@ -0,0 +1,233 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <ostream>
+#include <thread>
+
+#include <decompile.h>
+#include <metrics.h>
+#include <spsc_queue.h>
+
+// Streaming disassembly in three stages: a reader thread, the decoder on the calling thread and a writer
+// thread. Stages hand fixed-size chunks over bounded SPSC queues and return them on a second queue once
+// done, so buffers are reused and reading, decoding and writing of neighbouring chunks overlap.
+
+static constexpr size_t pipelineChunkSize = 64 * 1024;
+static constexpr size_t pipelineDepth = 4;
+
+// Longest 8086 instruction. Input chunks keep this much room in front of the data so the tail of an
+// instruction cut by the previous chunk can be copied there instead of moving the whole chunk.
+static constexpr size_t maxInstructionLength = 6;
+
+struct InputChunk {
+    std::vector<uint8_t> bytes;
+    size_t size = 0;
+    bool last = false;
+};
+
+struct OutputChunk {
+    std::string text;
+    bool last = false;
+};
+
+struct PipelineReport {
+    uint64_t bytes = 0;
+    bool readError = false;  // input stopped on an I/O error, not at its end; the output is incomplete
+    bool writeError = false;
+    uint64_t wallNanoseconds = 0;
+    std::array<uint64_t, static_cast<size_t>(DecoderStage::Count)> busyNanoseconds{};
+};
+
+// A read or write error ends the run normally and is flagged in the report. An exception in any stage is
+// rethrown once all of them have finished: the failed stage still passes the end of input on, the others
+// keep draining their queues without doing any more work, and the reader stops early.
+static PipelineReport decompilePipelined(const fs::path &input, std::ostream &output) {
+    std::ifstream in(input, std::ios::binary);
+    if (!in) throw std::runtime_error("Unable to open " + input.string());
+
+    auto wallStart = std::chrono::steady_clock::now();
+    PipelineReport report;
+    auto &busy = report.busyNanoseconds;
+
+    SpscQueue<InputChunk, pipelineDepth> filledInput;
+    SpscQueue<InputChunk, pipelineDepth> freeInput;
+    SpscQueue<OutputChunk, pipelineDepth> filledOutput;
+    SpscQueue<OutputChunk, pipelineDepth> freeOutput;
+
+    for (size_t i = 0; i < pipelineDepth; i++) {
+        freeInput.push(InputChunk{.bytes = std::vector<uint8_t>(maxInstructionLength + pipelineChunkSize)});
+
+        OutputChunk chunk;
+        chunk.text.reserve(2 * pipelineChunkSize);
+        freeOutput.push(std::move(chunk));
+    }
+
+    DecoderCounters counters;
+    counters.runs = 1;
+
+    // First exception of each stage, and whether the reader should stop because of one downstream
+    std::array<std::exception_ptr, static_cast<size_t>(DecoderStage::Count)> errors;
+    std::atomic<bool> stopReading = false;
+    {
+        std::jthread reader([&] {
+            InputChunk chunk;
+            try {
+                for (auto last = false; !last;) {
+                    chunk = freeInput.pop();
+
+                    auto start = std::chrono::steady_clock::now();
+                    in.read(reinterpret_cast<char *>(chunk.bytes.data() + maxInstructionLength), pipelineChunkSize);
+                    chunk.size = static_cast<size_t>(in.gcount());
+                    chunk.last = last = !in || stopReading;
+                    busy[static_cast<size_t>(DecoderStage::Read)] += nanosecondsSince(start);
+
+                    if (in.bad()) {
+                        spdlog::error("Failed to read {} after {} bytes", input.string(), report.bytes + chunk.size);
+                        report.readError = true;
+                    }
+
+                    report.bytes += chunk.size;
+                    filledInput.push(std::move(chunk));
+                }
+            } catch (...) {
+                errors[static_cast<size_t>(DecoderStage::Read)] = std::current_exception();
+
+                // The decoder copies the carried bytes into the chunk, so it needs a full-sized one
+                if (chunk.bytes.size() != maxInstructionLength + pipelineChunkSize) {
+                    chunk = freeInput.pop();
+                }
+                chunk.size = 0;
+                chunk.last = true;
+                filledInput.push(std::move(chunk));
+            }
+        });
+
+        std::jthread writer([&] {
+            for (auto last = false; !last;) {
+                auto chunk = filledOutput.pop();
+
+                auto start = std::chrono::steady_clock::now();
+                try {
+                    if (!errors[static_cast<size_t>(DecoderStage::Write)]) {
+                        output.write(chunk.text.data(), static_cast<std::streamsize>(chunk.text.size()));
+                        if (chunk.last) {
+                            output.flush();
+                        }
+                    }
+                } catch (...) {
+                    errors[static_cast<size_t>(DecoderStage::Write)] = std::current_exception();
+                    stopReading = true;
+                }
+                busy[static_cast<size_t>(DecoderStage::Write)] += nanosecondsSince(start);
+
+                if (output.bad() && !report.writeError) {
+                    spdlog::error("Failed to write the disassembly");
+                    report.writeError = true;
+                }
+
+                last = chunk.last;
+                chunk.text.clear();
+                chunk.last = false;
+                freeOutput.push(std::move(chunk));
+            }
+        });
+
+        std::array<uint8_t, maxInstructionLength> carry{};
+        size_t carried = 0;
+        size_t offset = 0;
+        auto failed = false;
+
+        auto out = freeOutput.pop();
+        out.text.append("bits 16\n");
+
+        for (auto last = false; !last;) {
+            auto chunk = filledInput.pop();
+            last = chunk.last;
+
+            auto start = std::chrono::steady_clock::now();
+            try {
+                if (!failed) {
+                    auto begin = maxInstructionLength - carried;
+                    std::copy_n(carry.begin(), carried, chunk.bytes.begin() + static_cast<ptrdiff_t>(begin));
+                    auto window = std::span<const uint8_t>{chunk.bytes}.subspan(begin, carried + chunk.size);
+
+                    size_t i = 0;
+                    while (i < window.size()) {
+                        auto run = appendDisassemblyRun(out.text, window.subspan(i));
+                        i += run.bytesConsumed;
+                        counters.instructionsDecoded += run.instructions;
+
+                        if (run.status == DecodeStatus::Truncated && !last) {
+                            break; // the rest of the instruction comes with the next chunk
+                        }
+                        if (run.status != DecodeStatus::Ok) {
+                            DecodedInstruction instruction;
+                            decodeInstruction(window.subspan(i), instruction);
+                            reportDecodeFailure(run.status, instruction, offset + i, counters);
+                            failed = true;
+                            break;
+                        }
+                    }
+
+                    carried = failed ? 0 : window.size() - i;
+                    assert(carried < maxInstructionLength);
+                    std::copy_n(window.begin() + static_cast<ptrdiff_t>(i), carried, carry.begin());
+                    offset += i;
+                }
+            } catch (...) {
+                errors[static_cast<size_t>(DecoderStage::Decode)] = std::current_exception();
+                stopReading = true;
+                failed = true;
+            }
+            busy[static_cast<size_t>(DecoderStage::Decode)] += nanosecondsSince(start);
+
+            freeInput.push(std::move(chunk));
+
+            if (out.text.size() >= pipelineChunkSize && !last) {
+                filledOutput.push(std::move(out));
+                out = freeOutput.pop();
+            }
+        }
+
+        out.last = true;
+        filledOutput.push(std::move(out));
+
+        counters.bytesConsumed = offset;
+    }
+
+    for (const auto &error: errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    report.wallNanoseconds = nanosecondsSince(wallStart);
+
+    counters.stageNanoseconds = report.busyNanoseconds;
+    decoderMetrics().add(counters);
+
+    return report;
+}
+
+// Busy time per stage against wall time. Overlap above 1 means stages ran concurrently.
+static std::string formatPipelineReport(const PipelineReport &report) {
+    auto seconds = [](uint64_t nanoseconds) { return static_cast<double>(nanoseconds) * 1e-9; };
+
+    uint64_t busyTotal = 0;
+    for (auto nanoseconds: report.busyNanoseconds) {
+        busyTotal += nanoseconds;
+    }
+
+    auto wall = std::max(seconds(report.wallNanoseconds), 1e-9);
+    return std::format("pipeline: {} bytes in {:.6f} s ({:.2f} MB/s), read {:.6f} s, decode {:.6f} s, "
+                       "write {:.6f} s, overlap {:.2f}x\n",
+                       report.bytes, wall, static_cast<double>(report.bytes) / wall / 1e6,
+                       seconds(report.busyNanoseconds[static_cast<size_t>(DecoderStage::Read)]),
+                       seconds(report.busyNanoseconds[static_cast<size_t>(DecoderStage::Decode)]),
+                       seconds(report.busyNanoseconds[static_cast<size_t>(DecoderStage::Write)]),
+                       seconds(busyTotal) / wall);
+}
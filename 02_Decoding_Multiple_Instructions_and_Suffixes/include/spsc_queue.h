@@ -0,0 +1,61 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <utility>
+
+// Bounded lock-free queue for exactly one producer thread and one consumer thread.
+// push() blocks while the queue is full and pop() while it is empty, sleeping on the
+// opposite index with std::atomic::wait instead of spinning.
+template<typename T, size_t Capacity>
+class SpscQueue {
+    static_assert(std::has_single_bit(Capacity), "Capacity must be a power of two");
+
+public:
+    bool tryPush(T &value) {
+        auto tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.load(std::memory_order_acquire) == Capacity) {
+            return false;
+        }
+
+        slots_[tail & (Capacity - 1)] = std::move(value);
+        tail_.store(tail + 1, std::memory_order_release);
+        tail_.notify_one();
+        return true;
+    }
+
+    bool tryPop(T &value) {
+        auto head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire)) {
+            return false;
+        }
+
+        value = std::move(slots_[head & (Capacity - 1)]);
+        head_.store(head + 1, std::memory_order_release);
+        head_.notify_one();
+        return true;
+    }
+
+    void push(T value) {
+        while (!tryPush(value)) {
+            auto tail = tail_.load(std::memory_order_relaxed);
+            head_.wait(tail - Capacity, std::memory_order_acquire);
+        }
+    }
+
+    T pop() {
+        T value;
+        while (!tryPop(value)) {
+            tail_.wait(head_.load(std::memory_order_relaxed), std::memory_order_acquire);
+        }
+        return value;
+    }
+
+private:
+    // Producer and consumer indices live on separate cache lines
+    alignas(64) std::atomic<size_t> head_{0};
+    alignas(64) std::atomic<size_t> tail_{0};
+    alignas(64) std::array<T, Capacity> slots_{};
+};
@@ -0,0 +1,174 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <thread>
+
+#include <decompile.h>
+
+// Instruction mix of one or more binaries, accumulated by decoding only: no text is produced.
+// Every worker thread fills its own histogram and they are merged once at the end.
+struct alignas(64) DecodeStats {
+    uint64_t bytes = 0;
+    uint64_t bytesDecoded = 0;
+    uint64_t instructions = 0;
+    uint64_t failures = 0; // inputs where decoding stopped before the end
+    uint64_t directAddresses = 0; // mod=00 r/m=110, a 16-bit address instead of [bp]
+
+    std::array<uint64_t, 256> opcodes{};
+    std::array<std::array<uint64_t, 8>, 4> modRm{}; // [mod][r/m] of register/memory MOVs
+
+    uint64_t movRegisterToRegister = 0;
+    uint64_t movMemory = 0;
+    uint64_t movImmediateToRegister = 0;
+    uint64_t displacement8 = 0;
+    uint64_t displacement16 = 0;
+
+    DecodeStats &operator+=(const DecodeStats &other) {
+        bytes += other.bytes;
+        bytesDecoded += other.bytesDecoded;
+        instructions += other.instructions;
+        failures += other.failures;
+        directAddresses += other.directAddresses;
+
+        for (size_t i = 0; i < opcodes.size(); i++) {
+            opcodes[i] += other.opcodes[i];
+        }
+        for (size_t mod = 0; mod < modRm.size(); mod++) {
+            for (size_t rm = 0; rm < modRm[mod].size(); rm++) {
+                modRm[mod][rm] += other.modRm[mod][rm];
+            }
+        }
+
+        movRegisterToRegister += other.movRegisterToRegister;
+        movMemory += other.movMemory;
+        movImmediateToRegister += other.movImmediateToRegister;
+        displacement8 += other.displacement8;
+        displacement16 += other.displacement16;
+        return *this;
+    }
+};
+
+static void accumulateStats(std::span<const uint8_t> binaryData, DecodeStats &stats) {
+    size_t i = 0;
+    while (i < binaryData.size()) {
+        DecodedInstruction instruction;
+        if (decodeInstruction(binaryData.subspan(i), instruction) != DecodeStatus::Ok) {
+            stats.failures++;
+            break;
+        }
+
+        stats.instructions++;
+        stats.opcodes[instruction.opcode]++;
+
+        if (instruction.kind == InstructionKind::MovRegisterMemory) {
+            if (instruction.mod == 0b11) {
+                stats.modRm[instruction.mod][instruction.rm]++;
+                stats.movRegisterToRegister++;
+            } else if (instruction.mod == 0b00 && instruction.rm == 0b110) {
+                stats.directAddresses++;
+                stats.movMemory++;
+            } else {
+                stats.modRm[instruction.mod][instruction.rm]++;
+                stats.movMemory++;
+                stats.displacement8 += instruction.mod == 0b01;
+                stats.displacement16 += instruction.mod == 0b10;
+            }
+        } else if (instruction.kind == InstructionKind::MovImmediateToRegister) {
+            stats.movImmediateToRegister++;
+        }
+
+        i += instruction.length;
+    }
+
+    stats.bytes += binaryData.size();
+    stats.bytesDecoded += i;
+}
+
+// Decode every input on a pool of threads, one file at a time per thread
+static DecodeStats collectStats(const std::vector<fs::path> &inputs) {
+    auto hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+    auto workerCount = std::min<size_t>(inputs.size(), hardwareThreads);
+
+    std::vector<DecodeStats> perThread(workerCount);
+    std::atomic<size_t> nextInput{0};
+    {
+        std::vector<std::jthread> workers;
+        for (size_t w = 0; w < workerCount; w++) {
+            workers.emplace_back([&, w] {
+                for (auto index = nextInput.fetch_add(1, std::memory_order_relaxed);
+                     index < inputs.size();
+                     index = nextInput.fetch_add(1, std::memory_order_relaxed)) {
+                    accumulateStats(readFile(inputs[index]), perThread[w]);
+                }
+            });
+        }
+    }
+
+    DecodeStats total;
+    for (const auto &stats: perThread) {
+        total += stats;
+    }
+    return total;
+}
+
+static std::string formatStatsTable(const DecodeStats &stats) {
+    std::string out;
+    out.append(std::format("{:<28}{:>12}\n", "bytes", stats.bytes));
+    out.append(std::format("{:<28}{:>12}\n", "bytes decoded", stats.bytesDecoded));
+    out.append(std::format("{:<28}{:>12}\n", "instructions", stats.instructions));
+    out.append(std::format("{:<28}{:>12}\n", "decoding failures", stats.failures));
+    out.append(std::format("{:<28}{:>12}\n", "direct addresses", stats.directAddresses));
+    out.append(std::format("{:<28}{:>12}\n", "mov register to register", stats.movRegisterToRegister));
+    out.append(std::format("{:<28}{:>12}\n", "mov register/memory", stats.movMemory));
+    out.append(std::format("{:<28}{:>12}\n", "mov immediate to register", stats.movImmediateToRegister));
+    out.append(std::format("{:<28}{:>12}\n", "8-bit displacements", stats.displacement8));
+    out.append(std::format("{:<28}{:>12}\n", "16-bit displacements", stats.displacement16));
+
+    out.append("\nopcode            count\n");
+    for (size_t opcode = 0; opcode < stats.opcodes.size(); opcode++) {
+        if (stats.opcodes[opcode] != 0) {
+            out.append(std::format("{:08b}  {:>12}\n", opcode, stats.opcodes[opcode]));
+        }
+    }
+
+    out.append(std::format("\n{:<16}{:>12}{:>12}{:>12}\n", "address", "mod=00", "mod=01", "mod=10"));
+    for (size_t rm = 0; rm < effectiveAddressBases.size(); rm++) {
+        // mod=00 r/m=110 is a direct address, counted above instead of as [bp]
+        auto mod00 = rm == 0b110 ? std::string{"-"} : std::format("{}", stats.modRm[0b00][rm]);
+        out.append(std::format("{:<16}{:>12}{:>12}{:>12}\n", std::format("[{}]", effectiveAddressBases[rm]),
+                               mod00, stats.modRm[0b01][rm], stats.modRm[0b10][rm]));
+    }
+
+    return out;
+}
+
+static std::string formatStatsJson(const DecodeStats &stats) {
+    std::string out;
+    out.append(std::format(R"({{"bytes":{},"bytesDecoded":{},"instructions":{},"failures":{},"directAddresses":{},)",
+                           stats.bytes, stats.bytesDecoded, stats.instructions, stats.failures,
+                           stats.directAddresses));
+    out.append(std::format(R"("mov":{{"registerToRegister":{},"registerMemory":{},"immediateToRegister":{}}},)",
+                           stats.movRegisterToRegister, stats.movMemory, stats.movImmediateToRegister));
+    out.append(std::format(R"("displacement":{{"8":{},"16":{}}},)", stats.displacement8, stats.displacement16));
+
+    out.append(R"("opcodes":{)");
+    auto first = true;
+    for (size_t opcode = 0; opcode < stats.opcodes.size(); opcode++) {
+        if (stats.opcodes[opcode] != 0) {
+            out.append(std::format(R"({}"{:08b}":{})", first ? "" : ",", opcode, stats.opcodes[opcode]));
+            first = false;
+        }
+    }
+
+    out.append(R"(},"effectiveAddresses":{)");
+    for (size_t rm = 0; rm < effectiveAddressBases.size(); rm++) {
+        auto mod00 = rm == 0b110 ? std::string{"null"} : std::format("{}", stats.modRm[0b00][rm]);
+        out.append(std::format(R"({}"[{}]":{{"mod00":{},"mod01":{},"mod10":{}}})", rm == 0 ? "" : ",",
+                               effectiveAddressBases[rm],
+                               mod00, stats.modRm[0b01][rm], stats.modRm[0b10][rm]));
+    }
+    out.append("}}\n");
+
+    return out;
+}
@@ -1,20 +1,101 @@
 // Lesson 02: Decoding Multiple Instructions and Suffixes
 // https://www.computerenhance.com/p/decoding-multiple-instructions-and
 
+#include <control_flow.h>
+#include <daemon.h>
 #include <decompile.h>
+#include <metrics.h>
+#include <pipeline.h>
+#include <stats.h>
+
+#include <csignal>
 
 int main(int argc, char* argv[]) {
     // disable debug logging
     spdlog::set_level(spdlog::level::off);
 
-    auto filePath = parseArgs(argc, argv);
-    if (!filePath.has_value()) {
+    auto options = parseArgs(argc, argv);
+    if (!options.has_value()) {
+        return 1;
+    }
+
+    if (options->isa.has_value() && !forceDecoderIsa(options->isa.value())) {
+        std::cerr << std::format("--isa={} is not supported by this CPU\n",
+                                 decoderIsaNames[static_cast<size_t>(options->isa.value())]);
         return 1;
     }
-    auto binaryData = readFile(filePath.value());
-    auto source = decompile(binaryData);
 
-    std::cout << source;
+    if (options->daemonSocket.has_value()) {
+#ifdef __linux__
+        static DisassemblyDaemon *runningDaemon = nullptr;
+        DisassemblyDaemon server(options->daemonSocket.value(), std::thread::hardware_concurrency());
+        runningDaemon = &server;
+
+        auto stopDaemon = [](int) { runningDaemon->stop(); };
+        std::signal(SIGINT, stopDaemon);
+        std::signal(SIGTERM, stopDaemon);
+
+        server.run();
+        return 0;
+#else
+        std::cerr << "--daemon is only supported on Linux\n";
+        return 1;
+#endif
+    }
+
+    if (options->stats) {
+        auto stats = collectStats(options->inputs);
+        std::cout << (options->json ? formatStatsJson(stats) : formatStatsTable(stats)) << std::flush;
+        if (!std::cout) {
+            std::cerr << "Failed to write the statistics\n";
+            return 1;
+        }
+        return 0;
+    }
+
+    if (options->pipeline) {
+        auto report = decompilePipelined(options->inputs.front(), std::cout);
+        std::cerr << formatPipelineReport(report);
+        if (report.readError) {
+            std::cerr << std::format("Failed to read {} after {} bytes\n", options->inputs.front().string(), report.bytes);
+        }
+        if (report.writeError) {
+            std::cerr << "Failed to write the disassembly\n";
+        }
+
+        if (options->metrics.has_value()) {
+            std::cerr << formatMetrics(decoderMetrics().snapshot(), options->metrics.value());
+        }
+        return report.readError || report.writeError ? 1 : 0;
+    }
+
+    DecoderCounters stages;
+
+    auto readStart = std::chrono::steady_clock::now();
+    auto binaryData = readFile(options->inputs.front());
+    stages.stageNanoseconds[static_cast<size_t>(DecoderStage::Read)] = nanosecondsSince(readStart);
+
+    constexpr size_t entryPoints[] = {0};
+    auto flow = options->labels ? std::optional{analyzeControlFlow(binaryData, entryPoints)} : std::nullopt;
+
+    // One upstream allocation for the whole output, released when the run ends
+    auto outputSize = flow.has_value() ? estimateLabelledDisassemblySize(binaryData.size(), flow.value())
+                                       : estimateDisassemblySize(binaryData.size());
+    std::pmr::monotonic_buffer_resource arena(outputSize + 4096);
+    auto source = flow.has_value() ? decompileWithLabels(binaryData, flow.value(), &arena)
+                                   : decompile(binaryData, &arena);
+
+    auto writeStart = std::chrono::steady_clock::now();
+    std::cout << source << std::flush;
+    stages.stageNanoseconds[static_cast<size_t>(DecoderStage::Write)] = nanosecondsSince(writeStart);
+    if (!std::cout) {
+        std::cerr << "Failed to write the disassembly\n";
+    }
+
+    decoderMetrics().add(stages);
+    if (options->metrics.has_value()) {
+        std::cerr << formatMetrics(decoderMetrics().snapshot(), options->metrics.value());
+    }
 
-    return 0;
+    return std::cout ? 0 : 1;
 }
@@ -0,0 +1,121 @@
+#include <gtest/gtest.h>
+#include <memory_resource>
+
+#include <control_flow.h>
+#include <decompile.h>
+
+// Forwards to new/delete and counts what reaches it
+class CountingResource : public std::pmr::memory_resource {
+public:
+    size_t allocations = 0;
+    size_t bytes = 0;
+
+private:
+    void *do_allocate(size_t size, size_t alignment) override {
+        allocations++;
+        bytes += size;
+        return std::pmr::new_delete_resource()->allocate(size, alignment);
+    }
+
+    void do_deallocate(void *pointer, size_t size, size_t alignment) override {
+        std::pmr::new_delete_resource()->deallocate(pointer, size, alignment);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override {
+        return this == &other;
+    }
+};
+
+// Register, immediate and displacement forms, ~5.7 characters of output per byte
+static std::vector<uint8_t> repeatedInstructions(size_t count) {
+    std::vector<uint8_t> binary;
+    for (size_t i = 0; i < count; i++) {
+        binary.insert(binary.end(), {0x89, 0xd9, 0x8a, 0x60, 0x04, 0xb9, 0x0c, 0x00, 0x8b, 0x88, 0x87, 0x13});
+    }
+    return binary;
+}
+
+TEST(ArenaDecompile, MatchesDefaultAllocator) {
+    auto binary = repeatedInstructions(100);
+
+    constexpr size_t entryPoints[] = {0};
+    auto flow = analyzeControlFlow(binary, entryPoints);
+
+    std::pmr::monotonic_buffer_resource arena;
+    EXPECT_EQ(std::string_view{decompile(binary, &arena)}, decompile(binary));
+    EXPECT_EQ(std::string_view{decompileWithLabels(binary, flow, &arena)}, decompileWithLabels(binary));
+}
+
+// The estimate is an upper bound only if no instruction has more text per byte than the constant says
+TEST(ArenaDecompile, NoInstructionExceedsTextPerByte) {
+    for (uint32_t opcode = 0; opcode < 256; opcode++) {
+        for (uint32_t second = 0; second < 256; second++) {
+            for (uint8_t operand: {0x00, 0x7f, 0x80, 0xff}) {
+                std::array<uint8_t, 6> bytes = {static_cast<uint8_t>(opcode), static_cast<uint8_t>(second),
+                                                operand, operand, operand, operand};
+                DecodedInstruction instruction;
+                if (decodeInstruction(bytes, instruction) != DecodeStatus::Ok) {
+                    continue;
+                }
+                EXPECT_LE(formatInstruction(instruction).size(), maxInstructionTextPerByte * instruction.length)
+                        << formatInstruction(instruction);
+            }
+        }
+    }
+}
+
+static void expectSingleUpstreamAllocation(const std::vector<uint8_t> &binary) {
+    CountingResource upstream;
+    {
+        std::pmr::monotonic_buffer_resource arena(estimateDisassemblySize(binary.size()) + 4096, &upstream);
+        auto source = decompile(binary, &arena);
+        EXPECT_LE(source.size(), estimateDisassemblySize(binary.size()));
+    }
+
+    EXPECT_EQ(upstream.allocations, 1);
+}
+
+TEST(ArenaDecompile, EstimateNeedsSingleUpstreamAllocation) {
+    expectSingleUpstreamAllocation(repeatedInstructions(1000));
+}
+
+// mov al, [bx + si] over and over has the most text per byte
+TEST(ArenaDecompile, WorstCaseNeedsSingleUpstreamAllocation) {
+    std::vector<uint8_t> binary;
+    for (auto i = 0; i < 1'000'000; i++) {
+        binary.insert(binary.end(), {0x8a, 0x00});
+    }
+
+    expectSingleUpstreamAllocation(binary);
+    EXPECT_EQ(decompile(binary).size(), std::string_view{"bits 16\n"}.size() + 9 * binary.size());
+}
+
+// Every jmp short $+2 is a jump target, so each one adds a label line and names a label
+TEST(ArenaDecompile, WorstCaseLabelledNeedsSingleUpstreamAllocation) {
+    std::vector<uint8_t> binary;
+    for (auto i = 0; i < 100'000; i++) {
+        binary.insert(binary.end(), {0xeb, 0x00});
+    }
+
+    constexpr size_t entryPoints[] = {0};
+    auto flow = analyzeControlFlow(binary, entryPoints);
+    auto estimate = estimateLabelledDisassemblySize(binary.size(), flow);
+
+    CountingResource upstream;
+    {
+        std::pmr::monotonic_buffer_resource arena(estimate + 4096, &upstream);
+        auto source = decompileWithLabels(binary, flow, &arena);
+        EXPECT_LE(source.size(), estimate);
+        EXPECT_TRUE(source.ends_with("label_30d3c:\njmp short label_30d3e\nlabel_30d3e:\njmp short $+2\n")) << source.substr(source.size() - 64);
+    }
+
+    EXPECT_EQ(upstream.allocations, 1);
+}
+
+TEST(ArenaDecompile, AppendsToExistingOutput) {
+    std::vector<uint8_t> binary = {0x89, 0xd9};
+
+    std::string source = "; header\n";
+    decompile(binary, source);
+    EXPECT_EQ(source, "; header\nbits 16\nmov cx, bx\n");
+}
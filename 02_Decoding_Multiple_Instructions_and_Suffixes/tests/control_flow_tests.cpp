@@ -0,0 +1,144 @@
+#include <gtest/gtest.h>
+
+#include <control_flow.h>
+#include <encode.h>
+
+TEST(OffsetBitmap, SetsAndTestsOffsets) {
+    OffsetBitmap bitmap(130);
+    bitmap.set(0);
+    bitmap.set(63);
+    bitmap.set(64);
+    bitmap.set(129);
+
+    EXPECT_TRUE(bitmap.test(0));
+    EXPECT_TRUE(bitmap.test(63));
+    EXPECT_TRUE(bitmap.test(64));
+    EXPECT_TRUE(bitmap.test(129));
+    EXPECT_FALSE(bitmap.test(1));
+    EXPECT_FALSE(bitmap.test(128));
+    EXPECT_EQ(bitmap.count(), 4);
+}
+
+TEST(ControlFlow, SeparatesCodeFromData) {
+    spdlog::set_level(spdlog::level::off);
+
+    std::vector<uint8_t> binary = {
+            0x89, 0xd9,       // mov cx, bx
+            0x8a, 0x60, 0x04, // mov ah, [bx + si + 4]
+            0x0f, 0x00, 0xff, // not an instruction the decoder knows
+    };
+
+    constexpr size_t entryPoints[] = {0};
+    auto flow = analyzeControlFlow(binary, entryPoints);
+
+    EXPECT_TRUE(flow.instructionStarts.test(0));
+    EXPECT_TRUE(flow.instructionStarts.test(2));
+    EXPECT_EQ(flow.instructionStarts.count(), 2);
+    EXPECT_EQ(flow.code.count(), 5);
+    EXPECT_EQ(flow.jumpTargets.count(), 0);
+
+    EXPECT_EQ(decompileWithLabels(binary, flow),
+              "bits 16\n"
+              "mov cx, bx\n"
+              "mov ah, [bx + si + 4]\n"
+              "db 15, 0, 255\n");
+}
+
+TEST(ControlFlow, FollowsEveryEntryPoint) {
+    spdlog::set_level(spdlog::level::off);
+
+    std::vector<uint8_t> binary = {
+            0x89, 0xd9, // mov cx, bx
+            0xff,       // data
+            0xb1, 0x0c, // mov cl, 12
+    };
+
+    constexpr size_t entryPoints[] = {0, 3};
+    auto flow = analyzeControlFlow(binary, entryPoints);
+
+    // Decoding from 0 stops at the unknown byte, 3 is only reached as a separate entry point
+    EXPECT_EQ(decompileWithLabels(binary, flow),
+              "bits 16\n"
+              "mov cx, bx\n"
+              "db 255\n"
+              "mov cl, 12\n");
+}
+
+TEST(ControlFlow, OutputReassemblesToTheSameBytes) {
+    spdlog::set_level(spdlog::level::off);
+
+    std::vector<uint8_t> binary = {0x89, 0xd9, 0xb9, 0xf4, 0xff, 0x0f, 0x01, 0x02};
+
+    auto source = decompileWithLabels(binary);
+    auto reassembled = assemble(source);
+    ASSERT_TRUE(reassembled.has_value()) << source;
+    EXPECT_EQ(reassembled.value(), binary) << source;
+}
+
+TEST(ControlFlow, EmitsLabelsAtJumpTargets) {
+    spdlog::set_level(spdlog::level::off);
+
+    std::vector<uint8_t> binary = {
+            0xeb, 0x01,       // 0: jmp short 3
+            0xff,             // 2: data
+            0xb9, 0x03, 0x00, // 3: mov cx, 3
+            0x89, 0xd8,       // 6: mov ax, bx
+            0xe2, 0xfc,       // 8: loop 6
+            0x74, 0x03,       // 10: je 15
+            0xe8, 0x01, 0x00, // 12: call 16
+            0xc3,             // 15: ret
+            0xb0, 0x01,       // 16: mov al, 1
+            0xc2, 0x02, 0x00, // 18: ret 2
+            0xff,             // 21: data
+    };
+
+    constexpr size_t entryPoints[] = {0};
+    auto flow = analyzeControlFlow(binary, entryPoints);
+    EXPECT_EQ(flow.jumpTargets.count(), 4);
+    EXPECT_FALSE(flow.code.test(2));
+    EXPECT_FALSE(flow.code.test(21));
+
+    auto source = decompileWithLabels(binary, flow);
+    EXPECT_EQ(source,
+              "bits 16\n"
+              "jmp short label_0003\n"
+              "db 255\n"
+              "label_0003:\n"
+              "mov cx, 3\n"
+              "label_0006:\n"
+              "mov ax, bx\n"
+              "loop label_0006\n"
+              "je label_000f\n"
+              "call label_0010\n"
+              "label_000f:\n"
+              "ret\n"
+              "label_0010:\n"
+              "mov al, 1\n"
+              "ret 2\n"
+              "db 255\n");
+
+    auto reassembled = assemble(source);
+    ASSERT_TRUE(reassembled.has_value()) << source;
+    EXPECT_EQ(reassembled.value(), binary) << source;
+}
+
+TEST(ControlFlow, TargetsWithoutALineStayRelative) {
+    spdlog::set_level(spdlog::level::off);
+
+    std::vector<uint8_t> binary = {
+            0x74, 0x01, // 0: je 3, into the middle of the next instruction
+            0xb0, 0xc3, // 2: mov al, 195, where 195 is also a ret
+            0x75, 0x10, // 4: jne 22, past the end of the image
+    };
+
+    auto source = decompileWithLabels(binary);
+    EXPECT_EQ(source,
+              "bits 16\n"
+              "je $+3\n"
+              "mov al, 195\n"
+              "jne $+18\n");
+
+    auto reassembled = assemble(source);
+    ASSERT_TRUE(reassembled.has_value()) << source;
+    EXPECT_EQ(reassembled.value(), binary) << source;
+}
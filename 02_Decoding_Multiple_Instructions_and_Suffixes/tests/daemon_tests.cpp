@@ -0,0 +1,153 @@
+#include <gtest/gtest.h>
+
+#include <daemon.h>
+#include <encode.h>
+
+#ifdef __linux__
+
+#include <unistd.h>
+
+struct DaemonTest : ::testing::Test {
+    fs::path socketPath;
+    std::unique_ptr<DisassemblyDaemon> daemon;
+    std::jthread loop;
+
+    void SetUp() override {
+        spdlog::set_level(spdlog::level::off);
+
+        // UNIX socket paths are limited to ~108 characters, so don't use the build directory
+        socketPath = fs::temp_directory_path() / std::format("02_daemon_test_{}.sock", ::getpid());
+        daemon = std::make_unique<DisassemblyDaemon>(socketPath, 2);
+        loop = std::jthread([this] { daemon->run(); });
+    }
+
+    void TearDown() override {
+        daemon->stop();
+        loop.join();
+        daemon.reset();
+    }
+};
+
+TEST_F(DaemonTest, DisassemblesRawBytes) {
+    std::vector<uint8_t> binary = {0x89, 0xd9, 0xb1, 0x0c};
+
+    DaemonClient client(socketPath);
+    auto response = client.disassemble(binary);
+    ASSERT_TRUE(response.has_value()) << client.lastError();
+    EXPECT_EQ(response->status, ResponseStatus::Ok);
+    EXPECT_EQ(response->text, decompile(binary));
+
+    // Same connection, reused buffers
+    response = client.disassemble(std::vector<uint8_t>{0x8a, 0x60, 0x04});
+    ASSERT_TRUE(response.has_value()) << client.lastError();
+    EXPECT_EQ(response->text, "bits 16\nmov ah, [bx + si + 4]\n");
+}
+
+TEST_F(DaemonTest, ReportsWhereDecodingStopped) {
+    std::vector<uint8_t> binary = {0x89, 0xd9, 0x0f, 0xb1, 0x0c}; // mov cx, bx; unknown opcode; mov cl, 12
+
+    DaemonClient client(socketPath);
+    auto response = client.disassemble(binary);
+    ASSERT_TRUE(response.has_value()) << client.lastError();
+    EXPECT_EQ(response->status, ResponseStatus::DecodeStopped);
+    EXPECT_EQ(response->text, "bits 16\nmov cx, bx\n; decoding stopped at byte 2\n");
+
+    // A truncated instruction at the end stops decoding as well
+    response = client.disassemble(std::vector<uint8_t>{0x89, 0xd9, 0x8a, 0x80, 0x87});
+    ASSERT_TRUE(response.has_value()) << client.lastError();
+    EXPECT_EQ(response->status, ResponseStatus::DecodeStopped);
+    EXPECT_EQ(response->text, "bits 16\nmov cx, bx\n; decoding stopped at byte 2\n");
+}
+
+TEST_F(DaemonTest, DisassemblesFileRange) {
+    auto path = fs::temp_directory_path() / std::format("02_daemon_test_{}.bin", ::getpid());
+    auto binary = assemble("mov cx, bx\nmov cl, 12\nmov al, [bx + si + 4999]\n");
+    ASSERT_TRUE(binary.has_value());
+    std::ofstream(path, std::ios::binary)
+            .write(reinterpret_cast<const char *>(binary->data()), static_cast<std::streamsize>(binary->size()));
+
+    DaemonClient client(socketPath);
+    auto response = client.disassembleFile(path, 2, 2);
+    ASSERT_TRUE(response.has_value()) << client.lastError();
+    EXPECT_EQ(response->status, ResponseStatus::Ok);
+    EXPECT_EQ(response->text, "bits 16\nmov cl, 12\n");
+
+    EXPECT_FALSE(client.disassembleFile(path, 2, 100).has_value());
+    EXPECT_FALSE(client.disassembleFile(path.string() + ".missing", 0, 1).has_value());
+
+    fs::remove(path);
+}
+
+// Send one request, shut down the sending side and read until the daemon closes the connection
+static std::string requestThenHalfClose(const fs::path &socketPath, std::span<const uint8_t> payload) {
+    auto address = unixSocketAddress(socketPath);
+    auto fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || ::connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0) {
+        return "connect failed";
+    }
+
+    std::vector<uint8_t> request(frameHeaderSize);
+    writeFrameHeader(request.data(), static_cast<uint32_t>(payload.size()), static_cast<uint8_t>(RequestType::Bytes));
+    request.insert(request.end(), payload.begin(), payload.end());
+    [[maybe_unused]] auto sent = ::send(fd, request.data(), request.size(), MSG_NOSIGNAL);
+    ::shutdown(fd, SHUT_WR);
+
+    std::string response;
+    std::array<char, 4096> buffer;
+    for (ssize_t received; (received = ::recv(fd, buffer.data(), buffer.size(), 0)) > 0;) {
+        response.append(buffer.data(), static_cast<size_t>(received));
+    }
+    ::close(fd);
+    return response;
+}
+
+TEST_F(DaemonTest, AnswersRequestSentBeforeShutdown) {
+    std::vector<uint8_t> binary = {0x89, 0xd9, 0xb1, 0x0c};
+    auto text = decompile(binary);
+
+    for (auto i = 0; i < 50; i++) {
+        auto response = requestThenHalfClose(socketPath, binary);
+        ASSERT_EQ(response.size(), frameHeaderSize + text.size()) << i;
+        EXPECT_EQ(readFrameLength(reinterpret_cast<const uint8_t *>(response.data())), text.size());
+        EXPECT_EQ(static_cast<ResponseStatus>(response[4]), ResponseStatus::Ok);
+        EXPECT_EQ(response.substr(frameHeaderSize), text);
+    }
+}
+
+TEST(Daemon, RefusesToReplaceSomethingThatIsNotASocket) {
+    auto path = fs::temp_directory_path() / std::format("02_daemon_test_{}.txt", ::getpid());
+    std::ofstream(path) << "keep me";
+
+    EXPECT_THROW(DisassemblyDaemon(path, 1), std::runtime_error);
+    EXPECT_TRUE(fs::is_regular_file(path));
+
+    fs::remove(path);
+}
+
+TEST_F(DaemonTest, ServesConcurrentClients) {
+    std::vector<uint8_t> binary;
+    for (auto i = 0; i < 1000; i++) {
+        binary.insert(binary.end(), {0x89, 0xd9, 0x8a, 0x80, 0x87, 0x13});
+    }
+    auto expected = decompile(binary);
+
+    std::atomic<int> mismatches{0};
+    {
+        std::vector<std::jthread> clients;
+        for (auto c = 0; c < 4; c++) {
+            clients.emplace_back([&] {
+                DaemonClient client(socketPath);
+                for (auto r = 0; r < 50; r++) {
+                    auto response = client.disassemble(binary);
+                    if (!response.has_value() || response->text != expected) {
+                        mismatches++;
+                    }
+                }
+            });
+        }
+    }
+
+    EXPECT_EQ(mismatches.load(), 0);
+}
+
+#endif
@@ -0,0 +1,113 @@
+#include <gtest/gtest.h>
+#include <random>
+
+#include <decompile.h>
+#include <instruction_stream.h>
+
+// Every ISA variant of the decode kernel must produce exactly what the scalar one does. Variants the
+// host CPU lacks are skipped, so run this on an AVX-512 machine to cover all of them.
+
+static std::vector<DecoderIsa> supportedIsas() {
+    std::vector<DecoderIsa> isas;
+    for (size_t i = 0; i < decoderIsaNames.size(); i++) {
+        if (isDecoderIsaSupported(static_cast<DecoderIsa>(i))) {
+            isas.push_back(static_cast<DecoderIsa>(i));
+        }
+    }
+    return isas;
+}
+
+static std::vector<uint8_t> generateBytes(size_t count, uint32_t seed) {
+    std::mt19937 random(seed);
+    std::vector<uint8_t> binary(count);
+    std::ranges::generate(binary, [&] { return static_cast<uint8_t>(random()); });
+    return binary;
+}
+
+static void expectSameAsScalar(std::span<const uint8_t> binary, size_t textSize) {
+    std::string expected(textSize, '\0');
+    auto expectedRun = disassembleRun(DecoderIsa::Scalar, binary, expected);
+    expected.resize(expectedRun.textLength);
+
+    for (auto isa: supportedIsas()) {
+        SCOPED_TRACE(decoderIsaNames[static_cast<size_t>(isa)]);
+
+        std::string text(textSize, '\0');
+        auto run = disassembleRun(isa, binary, text);
+        text.resize(run.textLength);
+
+        EXPECT_EQ(run.bytesConsumed, expectedRun.bytesConsumed);
+        EXPECT_EQ(run.instructions, expectedRun.instructions);
+        EXPECT_EQ(run.status, expectedRun.status);
+        EXPECT_EQ(text, expected);
+    }
+}
+
+TEST(DecoderDispatch, ScalarIsAlwaysSupported) {
+    EXPECT_TRUE(isDecoderIsaSupported(DecoderIsa::Scalar));
+    EXPECT_TRUE(isDecoderIsaSupported(activeDecoderIsa()));
+}
+
+TEST(DecoderDispatch, ParsesVariantNames) {
+    EXPECT_EQ(parseDecoderIsa("scalar"), DecoderIsa::Scalar);
+    EXPECT_EQ(parseDecoderIsa("sse4.2"), DecoderIsa::Sse42);
+    EXPECT_EQ(parseDecoderIsa("avx2"), DecoderIsa::Avx2);
+    EXPECT_EQ(parseDecoderIsa("avx512"), DecoderIsa::Avx512);
+    EXPECT_EQ(parseDecoderIsa("neon"), std::nullopt);
+}
+
+TEST(DecoderDispatch, VariantsAgreeOnInstructionStreams) {
+    for (uint32_t seed = 1; seed <= 16; seed++) {
+        auto binary = generateInstructionStream(30000, seed);
+        expectSameAsScalar(binary, estimateDisassemblySize(binary.size()) * 2);
+    }
+}
+
+TEST(DecoderDispatch, VariantsAgreeOnRandomBytes) {
+    spdlog::set_level(spdlog::level::off);
+
+    // Mostly stops early on unknown or truncated instructions
+    for (uint32_t seed = 1; seed <= 256; seed++) {
+        auto binary = generateBytes(64, seed);
+        expectSameAsScalar(binary, 1024);
+    }
+}
+
+TEST(DecoderDispatch, VariantsAgreeWhenTextSpaceRunsOut) {
+    auto binary = generateInstructionStream(3000, 42);
+    for (size_t textSize = 0; textSize < 200; textSize += 7) {
+        SCOPED_TRACE(textSize);
+        expectSameAsScalar(binary, textSize);
+    }
+}
+
+TEST(DecoderDispatch, ForcedVariantIsUsedForDecompile) {
+    spdlog::set_level(spdlog::level::off);
+
+    auto binary = generateInstructionStream(15000, 7);
+    auto initial = activeDecoderIsa();
+
+    ASSERT_TRUE(forceDecoderIsa(DecoderIsa::Scalar));
+    auto expected = decompile(binary);
+
+    for (auto isa: supportedIsas()) {
+        SCOPED_TRACE(decoderIsaNames[static_cast<size_t>(isa)]);
+        ASSERT_TRUE(forceDecoderIsa(isa));
+        EXPECT_EQ(activeDecoderIsa(), isa);
+
+        std::array<uint64_t, decoderIsaNames.size()> runsBefore;
+        for (size_t i = 0; i < runsBefore.size(); i++) {
+            runsBefore[i] = decoderIsaRuns(static_cast<DecoderIsa>(i));
+        }
+
+        EXPECT_EQ(decompile(binary), expected);
+
+        // Only the forced variant ran
+        for (size_t i = 0; i < runsBefore.size(); i++) {
+            auto ran = decoderIsaRuns(static_cast<DecoderIsa>(i)) > runsBefore[i];
+            EXPECT_EQ(ran, static_cast<DecoderIsa>(i) == isa) << decoderIsaNames[i];
+        }
+    }
+
+    forceDecoderIsa(initial);
+}
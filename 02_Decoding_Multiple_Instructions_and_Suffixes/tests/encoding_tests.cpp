@@ -0,0 +1,121 @@
+#include <gtest/gtest.h>
+
+#include <decompile.h>
+#include <encode.h>
+
+struct EncodingCase {
+    std::string_view source;
+    std::vector<uint8_t> bytes;
+};
+
+// Expected bytes are what `nasm -f bin` produces for the same line
+struct InstructionEncoding : ::testing::TestWithParam<EncodingCase> {
+};
+
+TEST_P(InstructionEncoding, MatchesNasm) {
+    auto [source, bytes] = GetParam();
+
+    auto binary = assemble(source);
+    ASSERT_TRUE(binary.has_value()) << source;
+    EXPECT_EQ(binary.value(), bytes) << source;
+}
+
+INSTANTIATE_TEST_SUITE_P(Mov, InstructionEncoding, ::testing::Values(
+        // Register-to-register
+        EncodingCase{"mov cx, bx", {0x89, 0xd9}},
+        EncodingCase{"mov dh, al", {0x88, 0xc6}},
+        EncodingCase{"MOV AX, BX", {0x89, 0xd8}},
+
+        // Immediate-to-register
+        EncodingCase{"mov cl, 12", {0xb1, 0x0c}},
+        EncodingCase{"mov ch, -12", {0xb5, 0xf4}},
+        EncodingCase{"mov cx, -12", {0xb9, 0xf4, 0xff}},
+        EncodingCase{"mov dx, 3948", {0xba, 0x6c, 0x0f}},
+
+        // Source and destination address calculation
+        EncodingCase{"mov al, [bx + si]", {0x8a, 0x00}},
+        EncodingCase{"mov bx, [bp + di]", {0x8b, 0x1b}},
+        EncodingCase{"mov dx, [bp]", {0x8b, 0x56, 0x00}},
+        EncodingCase{"mov ah, [bx + si + 4]", {0x8a, 0x60, 0x04}},
+        EncodingCase{"mov al, [bx + si + 4999]", {0x8a, 0x80, 0x87, 0x13}},
+        EncodingCase{"mov [bp + si], cl", {0x88, 0x0a}},
+
+        // Signed displacements
+        EncodingCase{"mov ax, [bx + di - 37]", {0x8b, 0x41, 0xdb}},
+        EncodingCase{"mov [si - 300], cx", {0x89, 0x8c, 0xd4, 0xfe}},
+        EncodingCase{"mov [si + 65236], cx", {0x89, 0x8c, 0xd4, 0xfe}},
+
+        // Explicit sizes
+        EncodingCase{"mov [bp + di], byte 7", {0xc6, 0x03, 0x07}},
+        EncodingCase{"mov [di + 901], word 347", {0xc7, 0x85, 0x85, 0x03, 0x5b, 0x01}},
+
+        // Direct address and accumulator short forms
+        EncodingCase{"mov bp, [5]", {0x8b, 0x2e, 0x05, 0x00}},
+        EncodingCase{"mov ax, [2555]", {0xa1, 0xfb, 0x09}},
+        EncodingCase{"mov [15], ax", {0xa3, 0x0f, 0x00}},
+
+        // Directives and comments produce no bytes
+        EncodingCase{"; comment\nbits 16\n\nmov cx, bx ; trailing", {0x89, 0xd9}}
+));
+
+INSTANTIATE_TEST_SUITE_P(Branch, InstructionEncoding, ::testing::Values(
+        // Targets relative to the start of the instruction
+        EncodingCase{"jne $+2", {0x75, 0x00}},
+        EncodingCase{"je $-2", {0x74, 0xfc}},
+        EncodingCase{"jz $", {0x74, 0xfe}},
+        EncodingCase{"loop $-4", {0xe2, 0xfa}},
+        EncodingCase{"jcxz $+10", {0xe3, 0x08}},
+        EncodingCase{"call $+1000", {0xe8, 0xe5, 0x03}},
+
+        // jmp is short when it reaches, unless the size is given
+        EncodingCase{"jmp $+5", {0xeb, 0x03}},
+        EncodingCase{"jmp $+300", {0xe9, 0x29, 0x01}},
+        EncodingCase{"jmp short $+2", {0xeb, 0x00}},
+        EncodingCase{"jmp near $+3", {0xe9, 0x00, 0x00}},
+
+        EncodingCase{"ret", {0xc3}},
+        EncodingCase{"ret 4", {0xc2, 0x04, 0x00}},
+
+        // Labels before and after the branch
+        EncodingCase{"top:\nmov cx, bx\njne top", {0x89, 0xd9, 0x75, 0xfc}},
+        EncodingCase{"jmp done\nmov cx, bx\ndone:\nret", {0xeb, 0x02, 0x89, 0xd9, 0xc3}},
+        EncodingCase{"start: jmp start", {0xeb, 0xfe}}
+));
+
+TEST(InstructionEncoding, GrowsJumpsThatDontReach) {
+    std::string source = "jmp done\n";
+    for (auto i = 0; i < 50; i++) {
+        source.append("mov cx, 1000\n");
+    }
+    source.append("done:\nret\n");
+
+    // The first pass assumes a short jump, which moves `done` out of its reach
+    auto binary = assemble(source);
+    ASSERT_TRUE(binary.has_value());
+    ASSERT_EQ(binary->size(), 3 + 50 * 3 + 1);
+    EXPECT_EQ(std::vector(binary->begin(), binary->begin() + 3), (std::vector<uint8_t>{0xe9, 0x96, 0x00}));
+}
+
+TEST(InstructionEncoding, RejectsUnsupportedSource) {
+    spdlog::set_level(spdlog::level::off);
+
+    EXPECT_FALSE(assemble("add ax, bx").has_value());
+    EXPECT_FALSE(assemble("mov ax, bl").has_value());
+    EXPECT_FALSE(assemble("mov cl, 300").has_value());
+    EXPECT_FALSE(assemble("mov [bx], 7").has_value());
+    EXPECT_FALSE(assemble("mov ax, [bx + bp]").has_value());
+    EXPECT_FALSE(assemble("jne $+200").has_value());
+    EXPECT_FALSE(assemble("jmp short $+300").has_value());
+    EXPECT_FALSE(assemble("jne near $+2").has_value());
+    EXPECT_FALSE(assemble("call short $").has_value());
+    EXPECT_FALSE(assemble("jmp nowhere").has_value());
+    EXPECT_FALSE(assemble("ret -1").has_value());
+}
+
+TEST(InstructionEncoding, RoundTripsThroughDecoder) {
+    auto source = "bits 16\nmov si, bx\nmov cl, 12\nmov al, [bx + si + 4999]\nmov [bp], ch\n";
+
+    auto binary = assemble(source);
+    ASSERT_TRUE(binary.has_value());
+    EXPECT_EQ(decompile(binary.value()), source);
+}
@@ -0,0 +1,208 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include <decompile.h>
+#include <round_trip.h>
+
+// Enumerates the whole encoding space the decoder supports: every opcode byte, every mod reg r/m byte,
+// every displacement and immediate. Each encoding is decoded and must survive the round trip through
+// the in-process encoder (round_trip.h). Work is sharded by (opcode, mod reg r/m) over all cores.
+
+struct ShardResult {
+    uint64_t verified = 0;
+    uint64_t failed = 0;
+    std::vector<std::string> examples;
+};
+
+static void verifyEncoding(std::span<const uint8_t> bytes, ShardResult &result) {
+    auto fail = [&](std::string_view reason) {
+        result.failed++;
+        if (result.examples.size() < 8) {
+            result.examples.push_back(std::format("{}: {}", hexBytes(bytes), reason));
+        }
+    };
+
+    DecodedInstruction decoded;
+    if (decodeInstruction(bytes, decoded) != DecodeStatus::Ok) {
+        return fail("not decoded");
+    }
+    if (decoded.length != bytes.size()) {
+        return fail(std::format("decoded {} bytes", decoded.length));
+    }
+
+    for (size_t prefix = 1; prefix < bytes.size(); prefix++) {
+        DecodedInstruction truncated;
+        if (decodeInstruction(bytes.first(prefix), truncated) != DecodeStatus::Truncated) {
+            return fail(std::format("{} byte prefix is not reported as truncated", prefix));
+        }
+    }
+
+    if (auto mismatch = roundTripMismatch(decoded)) {
+        return fail(mismatch.value());
+    }
+
+    result.verified++;
+}
+
+// Run shards [0, shardCount) on every core, merging per-thread results at the end
+static ShardResult runSharded(size_t shardCount, const std::function<void(size_t, ShardResult &)> &shard) {
+    auto workerCount = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<ShardResult> perThread(workerCount);
+    std::atomic<size_t> nextShard{0};
+    {
+        std::vector<std::jthread> workers;
+        for (size_t w = 0; w < workerCount; w++) {
+            workers.emplace_back([&, w] {
+                for (auto index = nextShard.fetch_add(1, std::memory_order_relaxed);
+                     index < shardCount;
+                     index = nextShard.fetch_add(1, std::memory_order_relaxed)) {
+                    shard(index, perThread[w]);
+                }
+            });
+        }
+    }
+
+    ShardResult total;
+    for (auto &result: perThread) {
+        total.verified += result.verified;
+        total.failed += result.failed;
+        for (auto &example: result.examples) {
+            if (total.examples.size() < 32) {
+                total.examples.push_back(std::move(example));
+            }
+        }
+    }
+    return total;
+}
+
+static void expectAllVerified(const ShardResult &result) {
+    EXPECT_GT(result.verified, 0);
+    EXPECT_EQ(result.failed, 0) << [&] {
+        std::string examples;
+        for (const auto &example: result.examples) {
+            examples.append(example).append("\n");
+        }
+        return examples;
+    }();
+}
+
+static void enumerateRegisterMemory(uint8_t opcode, uint8_t modRm, bool supported, ShardResult &result) {
+    auto mod = static_cast<uint8_t>(modRm >> 6);
+    auto reg = static_cast<uint8_t>((modRm >> 3) & 0b111);
+    auto rm = static_cast<uint8_t>(modRm & 0b111);
+    auto direct = mod == 0b00 && rm == 0b110;
+    auto displacementCount = mod == 0b01 ? 0x100u : (mod == 0b10 || direct) ? 0x10000u : 1u;
+
+    for (uint32_t displacement = 0; displacement < displacementCount; displacement++) {
+        if (isSupportedRegisterMemory(mod, reg, rm, static_cast<uint16_t>(displacement)) != supported) {
+            continue;
+        }
+
+        std::array<uint8_t, 4> bytes = {opcode, modRm,
+                                        static_cast<uint8_t>(displacement & 0xff),
+                                        static_cast<uint8_t>(displacement >> 8)};
+        auto length = mod == 0b01 ? 3 : (mod == 0b10 || direct) ? 4 : 2;
+        verifyEncoding(std::span{bytes}.first(length), result);
+    }
+}
+
+TEST(ExhaustiveEncodingSpace, RegisterMemoryMov) {
+    spdlog::set_level(spdlog::level::off);
+
+    // One shard per (opcode 100010dw, mod reg r/m)
+    auto result = runSharded(4 * 256, [](size_t shard, ShardResult &result) {
+        auto opcode = static_cast<uint8_t>(0b10001000 | (shard >> 8));
+        enumerateRegisterMemory(opcode, static_cast<uint8_t>(shard & 0xff), true, result);
+    });
+
+    expectAllVerified(result);
+}
+
+TEST(ExhaustiveEncodingSpace, ImmediateToRegisterMov) {
+    spdlog::set_level(spdlog::level::off);
+
+    // One shard per opcode 1011wreg
+    auto result = runSharded(16, [](size_t shard, ShardResult &result) {
+        auto opcode = static_cast<uint8_t>(0b10110000 | shard);
+        auto immediateCount = (opcode & 0b1000) ? 0x10000u : 0x100u;
+
+        for (uint32_t immediate = 0; immediate < immediateCount; immediate++) {
+            std::array<uint8_t, 3> bytes = {opcode,
+                                            static_cast<uint8_t>(immediate & 0xff),
+                                            static_cast<uint8_t>(immediate >> 8)};
+            verifyEncoding(std::span{bytes}.first((opcode & 0b1000) ? 3 : 2), result);
+        }
+    });
+
+    expectAllVerified(result);
+}
+
+TEST(ExhaustiveEncodingSpace, ControlTransfer) {
+    spdlog::set_level(spdlog::level::off);
+
+    // Conditional jumps, loops and jmp short take disp8, jmp near and call disp16, ret pops a data16
+    static constexpr std::array<uint8_t, 24> opcodes = {
+            0x70, 0x71, 0x72, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x7b,
+            0x7c, 0x7d, 0x7e, 0x7f, 0xe0, 0xe1, 0xe2, 0xe3, 0xeb, 0xe8, 0xe9, 0xc2,
+    };
+
+    // One shard per opcode, plus ret without an operand
+    auto result = runSharded(opcodes.size() + 1, [](size_t shard, ShardResult &result) {
+        if (shard == opcodes.size()) {
+            constexpr uint8_t ret[] = {0xc3};
+            verifyEncoding(ret, result);
+            return;
+        }
+
+        auto opcode = opcodes[shard];
+        auto wide = opcode == 0xe8 || opcode == 0xe9 || opcode == 0xc2;
+        for (uint32_t operand = 0; operand < (wide ? 0x10000u : 0x100u); operand++) {
+            std::array<uint8_t, 3> bytes = {opcode,
+                                            static_cast<uint8_t>(operand & 0xff),
+                                            static_cast<uint8_t>(operand >> 8)};
+            verifyEncoding(std::span{bytes}.first(wide ? 3 : 2), result);
+        }
+    });
+
+    expectAllVerified(result);
+}
+
+TEST(ExhaustiveEncodingSpace, UnsupportedOpcodesAreRejected) {
+    spdlog::set_level(spdlog::level::off);
+
+    for (uint32_t opcode = 0; opcode < 256; opcode++) {
+        auto supported = (opcode & ~0b11u) == 0b10001000 || (opcode & ~0b1111u) == 0b10110000 ||
+                         (opcode & ~0b1111u) == 0b01110000 || (opcode & ~0b11u) == 0b11100000 ||
+                         opcode == 0b11101000 || opcode == 0b11101001 || opcode == 0b11101011 ||
+                         (opcode & ~0b1u) == 0b11000010;
+        auto notImplemented = (opcode & ~0b1u) == 0b11000110 || (opcode & ~0b11u) == 0b10100000;
+
+        std::array<uint8_t, 6> bytes = {static_cast<uint8_t>(opcode), 0, 0, 0, 0, 0};
+        DecodedInstruction instruction;
+        auto status = decodeInstruction(bytes, instruction);
+
+        if (supported) {
+            EXPECT_EQ(status, DecodeStatus::Ok) << std::format("{:08b}", opcode);
+        } else if (notImplemented) {
+            EXPECT_EQ(status, DecodeStatus::NotImplemented) << std::format("{:08b}", opcode);
+        } else {
+            EXPECT_EQ(status, DecodeStatus::Unknown) << std::format("{:08b}", opcode);
+        }
+    }
+}
+
+// The part of the space excluded above. Enable once signed displacements are printed and the accumulator
+// MOVs are decoded.
+TEST(ExhaustiveEncodingSpace, DISABLED_SignedDisplacementsAndAccumulatorForms) {
+    spdlog::set_level(spdlog::level::off);
+
+    auto result = runSharded(4 * 256, [](size_t shard, ShardResult &result) {
+        auto opcode = static_cast<uint8_t>(0b10001000 | (shard >> 8));
+        enumerateRegisterMemory(opcode, static_cast<uint8_t>(shard & 0xff), false, result);
+    });
+
+    expectAllVerified(result);
+}
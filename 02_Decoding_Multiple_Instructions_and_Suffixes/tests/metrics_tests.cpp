@@ -0,0 +1,68 @@
+#include <gtest/gtest.h>
+
+#include <decompile.h>
+#include <metrics.h>
+
+// The metrics are process-wide and other tests decode too, so only compare deltas
+struct DecoderMetricsTest : ::testing::Test {
+    DecoderCounters before;
+
+    void SetUp() override {
+        spdlog::set_level(spdlog::level::off);
+        before = decoderMetrics().snapshot();
+    }
+
+    DecoderCounters delta() {
+        auto after = decoderMetrics().snapshot();
+        DecoderCounters counters;
+        counters.runs = after.runs - before.runs;
+        counters.bytesConsumed = after.bytesConsumed - before.bytesConsumed;
+        counters.instructionsDecoded = after.instructionsDecoded - before.instructionsDecoded;
+        counters.unknownOpcodes = after.unknownOpcodes - before.unknownOpcodes;
+        counters.notImplemented = after.notImplemented - before.notImplemented;
+        counters.truncatedInstructions = after.truncatedInstructions - before.truncatedInstructions;
+        return counters;
+    }
+};
+
+TEST_F(DecoderMetricsTest, CountsDecodedInstructions) {
+    decompile(std::vector<uint8_t>{0x89, 0xd9, 0xb1, 0x0c}); // mov cx, bx; mov cl, 12
+
+    auto counters = delta();
+    EXPECT_EQ(counters.runs, 1);
+    EXPECT_EQ(counters.bytesConsumed, 4);
+    EXPECT_EQ(counters.instructionsDecoded, 2);
+    EXPECT_EQ(counters.unknownOpcodes, 0);
+    EXPECT_EQ(counters.notImplemented, 0);
+    EXPECT_EQ(counters.truncatedInstructions, 0);
+}
+
+TEST_F(DecoderMetricsTest, CountsBailouts) {
+    decompile(std::vector<uint8_t>{0x89, 0xd9, 0x0f});       // unknown opcode
+    decompile(std::vector<uint8_t>{0xa1, 0x00, 0x00});       // memory to accumulator
+    decompile(std::vector<uint8_t>{0x8a, 0x80, 0x87});       // 16-bit displacement cut short
+
+    auto counters = delta();
+    EXPECT_EQ(counters.runs, 3);
+    EXPECT_EQ(counters.bytesConsumed, 2);
+    EXPECT_EQ(counters.instructionsDecoded, 1);
+    EXPECT_EQ(counters.unknownOpcodes, 1);
+    EXPECT_EQ(counters.notImplemented, 1);
+    EXPECT_EQ(counters.truncatedInstructions, 1);
+}
+
+TEST(DecoderMetricsFormat, WritesPrometheusAndJson) {
+    DecoderCounters counters;
+    counters.runs = 2;
+    counters.instructionsDecoded = 7;
+    counters.stageNanoseconds[static_cast<size_t>(DecoderStage::Decode)] = 1500;
+
+    auto prometheus = formatMetrics(counters, MetricsFormat::Prometheus);
+    EXPECT_NE(prometheus.find("# TYPE decoder_runs_total counter\ndecoder_runs_total 2\n"), std::string::npos);
+    EXPECT_NE(prometheus.find("decoder_instructions_decoded_total 7\n"), std::string::npos);
+    EXPECT_NE(prometheus.find("decoder_stage_seconds_total{stage=\"decode\"} 0.000001500\n"), std::string::npos);
+
+    auto json = formatMetrics(counters, MetricsFormat::Json);
+    EXPECT_TRUE(json.starts_with(R"({"runs":2,"bytesConsumed":0,"instructionsDecoded":7,)")) << json;
+    EXPECT_NE(json.find(R"("stageNanoseconds":{"read":0,"decode":1500,"write":0}})"), std::string::npos) << json;
+}
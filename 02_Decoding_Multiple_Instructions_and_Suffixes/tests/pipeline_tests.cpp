@@ -0,0 +1,108 @@
+#include <gtest/gtest.h>
+#include <sstream>
+
+#include <decompile.h>
+#include <pipeline.h>
+#include <instruction_stream.h>
+
+static const std::string WORK_BASE = WORK_BASE_DIR;
+
+struct PipelineTest : ::testing::Test {
+    fs::path path;
+
+    void SetUp() override {
+        spdlog::set_level(spdlog::level::off);
+
+        auto workDir = fs::path(WORK_BASE) / "pipeline";
+        fs::create_directories(workDir);
+        path = workDir / (std::string(::testing::UnitTest::GetInstance()->current_test_info()->name()) + ".bin");
+    }
+
+    void ExpectSameAsDecompile(const std::vector<uint8_t> &bytes) {
+        std::ofstream(path, std::ios::binary)
+                .write(reinterpret_cast<const char *>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+
+        std::ostringstream streamed;
+        auto report = decompilePipelined(path, streamed);
+
+        EXPECT_EQ(report.bytes, bytes.size());
+        EXPECT_FALSE(report.readError);
+        EXPECT_FALSE(report.writeError);
+        EXPECT_EQ(streamed.str(), decompile(bytes));
+    }
+};
+
+TEST_F(PipelineTest, MatchesDecompileAcrossChunkBoundaries) {
+    ExpectSameAsDecompile(generateInstructionStream(5 * pipelineChunkSize + 123, 1));
+}
+
+TEST_F(PipelineTest, MatchesDecompileOnExactChunkMultiple) {
+    auto bytes = generateInstructionStream(2 * pipelineChunkSize, 2);
+    bytes.resize(2 * pipelineChunkSize);
+    ExpectSameAsDecompile(bytes);
+}
+
+TEST_F(PipelineTest, StopsOnUnknownOpcodeLikeDecompile) {
+    auto bytes = generateInstructionStream(3 * pipelineChunkSize, 3);
+    bytes.insert(bytes.begin() + static_cast<ptrdiff_t>(pipelineChunkSize), 0x0f);
+    ExpectSameAsDecompile(bytes);
+}
+
+TEST_F(PipelineTest, HandlesEmptyInput) {
+    ExpectSameAsDecompile({});
+}
+
+// A directory opens like a file on Linux, but reading it fails with EISDIR
+TEST_F(PipelineTest, ReportsReadErrorInsteadOfEndOfInput) {
+    std::ostringstream streamed;
+    auto report = decompilePipelined(path.parent_path(), streamed);
+
+    EXPECT_TRUE(report.readError);
+    EXPECT_FALSE(report.writeError);
+}
+
+TEST_F(PipelineTest, ReportsWriteError) {
+    auto bytes = generateInstructionStream(pipelineChunkSize, 4);
+    std::ofstream(path, std::ios::binary)
+            .write(reinterpret_cast<const char *>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+
+    std::ostringstream streamed;
+    streamed.setstate(std::ios::badbit);
+    auto report = decompilePipelined(path, streamed);
+
+    EXPECT_FALSE(report.readError);
+    EXPECT_TRUE(report.writeError);
+}
+
+// Output whose writes throw instead of setting badbit, like a stream with exceptions enabled on a custom buffer
+struct ThrowingBuffer : std::streambuf {
+    std::streamsize xsputn(const char *, std::streamsize) override { throw std::runtime_error("disk on fire"); }
+    int_type overflow(int_type) override { throw std::runtime_error("disk on fire"); }
+};
+
+TEST_F(PipelineTest, RethrowsStageExceptionAfterOthersFinish) {
+    auto bytes = generateInstructionStream(3 * pipelineDepth * pipelineChunkSize, 5);
+    std::ofstream(path, std::ios::binary)
+            .write(reinterpret_cast<const char *>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+
+    ThrowingBuffer buffer;
+    std::ostream throwing(&buffer);
+    throwing.exceptions(std::ios::badbit);
+
+    EXPECT_THROW(decompilePipelined(path, throwing), std::runtime_error);
+}
+
+TEST(SpscQueue, DeliversInOrderAcrossThreads) {
+    SpscQueue<uint32_t, 8> queue;
+    constexpr uint32_t count = 100'000;
+
+    std::jthread producer([&] {
+        for (uint32_t i = 0; i < count; i++) {
+            queue.push(i);
+        }
+    });
+
+    for (uint32_t i = 0; i < count; i++) {
+        ASSERT_EQ(queue.pop(), i);
+    }
+}
@@ -0,0 +1,85 @@
+#include <gtest/gtest.h>
+
+#include <stats.h>
+
+TEST(DecodeStats, CountsInstructionMix) {
+    std::vector<uint8_t> binary = {
+            0x89, 0xd9,             // mov cx, bx
+            0x8a, 0x00,             // mov al, [bx + si]
+            0x8a, 0x60, 0x04,       // mov ah, [bx + si + 4]
+            0x8a, 0x80, 0x87, 0x13, // mov al, [bx + si + 4999]
+            0xb1, 0x0c,             // mov cl, 12
+    };
+
+    DecodeStats stats;
+    accumulateStats(binary, stats);
+
+    EXPECT_EQ(stats.bytes, binary.size());
+    EXPECT_EQ(stats.bytesDecoded, binary.size());
+    EXPECT_EQ(stats.instructions, 5);
+    EXPECT_EQ(stats.failures, 0);
+
+    EXPECT_EQ(stats.opcodes[0x89], 1);
+    EXPECT_EQ(stats.opcodes[0x8a], 3);
+    EXPECT_EQ(stats.opcodes[0xb1], 1);
+
+    EXPECT_EQ(stats.movRegisterToRegister, 1);
+    EXPECT_EQ(stats.movMemory, 3);
+    EXPECT_EQ(stats.movImmediateToRegister, 1);
+    EXPECT_EQ(stats.displacement8, 1);
+    EXPECT_EQ(stats.displacement16, 1);
+
+    EXPECT_EQ(stats.modRm[0b00][0b000], 1);
+    EXPECT_EQ(stats.modRm[0b01][0b000], 1);
+    EXPECT_EQ(stats.modRm[0b10][0b000], 1);
+    EXPECT_EQ(stats.modRm[0b11][0b001], 1);
+}
+
+TEST(DecodeStats, StopsOnUnsupportedAndTruncatedInstructions) {
+    DecodeStats stats;
+    accumulateStats(std::vector<uint8_t>{0x89, 0xd9, 0xa1, 0x00, 0x00}, stats); // mov ax, [0] is not implemented
+    accumulateStats(std::vector<uint8_t>{0x89, 0xd9, 0x8a, 0x80, 0x87}, stats); // 16-bit displacement cut short
+
+    EXPECT_EQ(stats.instructions, 2);
+    EXPECT_EQ(stats.failures, 2);
+    EXPECT_EQ(stats.bytes, 10);
+    EXPECT_EQ(stats.bytesDecoded, 4);
+}
+
+TEST(DecodeStats, DirectAddressIsNotCountedAsBp) {
+    DecodeStats stats;
+    // mov cx, bx; mov cx, [0x1234]; mov cx, bx
+    accumulateStats(std::vector<uint8_t>{0x89, 0xd9, 0x8b, 0x0e, 0x34, 0x12, 0x89, 0xd9}, stats);
+
+    EXPECT_EQ(stats.instructions, 3);
+    EXPECT_EQ(stats.directAddresses, 1);
+    EXPECT_EQ(stats.failures, 0);
+    EXPECT_EQ(stats.bytesDecoded, 8);
+    EXPECT_EQ(stats.movMemory, 1);
+    EXPECT_EQ(stats.displacement16, 0);
+    EXPECT_EQ(stats.modRm[0b00][0b110], 0);
+}
+
+TEST(DecodeStats, MergesPerThreadHistograms) {
+    DecodeStats a;
+    DecodeStats b;
+    accumulateStats(std::vector<uint8_t>{0x89, 0xd9}, a);
+    accumulateStats(std::vector<uint8_t>{0x89, 0xd9, 0xb1, 0x0c}, b);
+
+    a += b;
+    EXPECT_EQ(a.instructions, 3);
+    EXPECT_EQ(a.opcodes[0x89], 2);
+    EXPECT_EQ(a.modRm[0b11][0b001], 2);
+    EXPECT_EQ(a.movImmediateToRegister, 1);
+}
+
+TEST(DecodeStats, FormatsJson) {
+    DecodeStats stats;
+    accumulateStats(std::vector<uint8_t>{0x89, 0xd9}, stats);
+
+    auto json = formatStatsJson(stats);
+    EXPECT_TRUE(json.starts_with(R"({"bytes":2,"bytesDecoded":2,"instructions":1,"failures":0,"directAddresses":0,)"))
+                        << json;
+    EXPECT_NE(json.find(R"("[bp]":{"mod00":null,)"), std::string::npos) << json;
+    EXPECT_NE(json.find(R"("opcodes":{"10001001":1})"), std::string::npos) << json;
+}
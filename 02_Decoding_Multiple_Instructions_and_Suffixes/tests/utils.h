@@ -1,6 +1,11 @@
 #pragma once
 
+#include <cstdint>
+#include <iostream>
+#include <ranges>
 #include <string>
+#include <string_view>
+#include <vector>
 
 #ifdef _WIN32
 
@@ -0,0 +1,425 @@
+#include <decoder.h>
+
+#include <atomic>
+#include <cassert>
+#include <charconv>
+#include <cstring>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define DECODER_X86_DISPATCH
+#include <cpuid.h>
+#endif
+
+std::string_view decodeRegister(uint8_t bits, bool W) {
+    assert((bits >> 3) == 0);
+
+    static constexpr std::array<std::string_view, 8> bytes = {"al", "cl", "dl", "bl", "ah", "ch", "dh", "bh"};
+    static constexpr std::array<std::string_view, 8> words = {"ax", "cx", "dx", "bx", "sp", "bp", "si", "di"};
+
+    return W ? words[bits & 0b111] : bytes[bits & 0b111];
+}
+
+std::string_view memoryModeEffectiveAddress(uint8_t rm) {
+    assert((rm >> 3) == 0);
+
+    static constexpr std::array<std::string_view, 8> addresses = {
+            "[bx + si]", "[bx + di]", "[bp + si]", "[bp + di]", "[si]", "[di]",
+            {}, // direct address, printed from the displacement by writeInstruction()
+            "[bx]",
+    };
+
+    return addresses[rm & 0b111];
+}
+
+std::string_view branchMnemonic(const DecodedInstruction &instruction) {
+    static constexpr std::array<std::string_view, 16> conditions = {
+            "jo", "jno", "jb", "jnb", "je", "jne", "jbe", "ja", "js", "jns", "jp", "jnp", "jl", "jnl", "jle", "jg",
+    };
+    static constexpr std::array<std::string_view, 4> loops = {"loopnz", "loopz", "loop", "jcxz"};
+
+    switch (instruction.kind) {
+        case InstructionKind::ConditionalJump:
+            return conditions[instruction.opcode & 0b1111];
+        case InstructionKind::Loop:
+            return loops[instruction.opcode & 0b11];
+        case InstructionKind::JumpShort:
+            return "jmp short";
+        case InstructionKind::JumpNear:
+            return "jmp near";
+        case InstructionKind::CallNear:
+            return "call";
+        default:
+            assert(false && "Not a relative branch");
+            return {};
+    }
+}
+
+namespace {
+
+// The bodies of the hot functions are always inlined, so each ISA variant of disassembleRun() below gets
+// its own copy compiled for its target instead of calling back into the baseline code
+
+// Follow Intel-8086 user manual, page 261, section 4-18
+[[gnu::always_inline]] inline DecodeStatus decodeInstructionImpl(std::span<const uint8_t> bytes,
+                                                                 DecodedInstruction &instruction) {
+    assert(!bytes.empty());
+
+    auto byte = bytes[0];
+    instruction = DecodedInstruction{};
+    instruction.opcode = byte;
+    instruction.length = 1;
+
+    if ((byte & ~0b11) == 0b10001000) {
+        instruction.kind = InstructionKind::MovRegisterMemory;
+        instruction.D = (byte >> 1) & 1;
+        instruction.W = byte & 1;
+
+        if (bytes.size() < 2) {
+            return DecodeStatus::Truncated;
+        }
+
+        byte = bytes[1];
+        instruction.mod = (byte >> 6);
+        instruction.reg = (byte >> 3) & 0b111;
+        instruction.rm = byte & 0b111;
+        instruction.length = 2;
+
+        if (instruction.mod == 0b01) {
+            if (bytes.size() < 3) {
+                return DecodeStatus::Truncated;
+            }
+            instruction.displacement = bytes[2];
+            instruction.length = 3;
+        } else if (instruction.mod == 0b10 || (instruction.mod == 0b00 && instruction.rm == 0b110)) {
+            if (bytes.size() < 4) {
+                return DecodeStatus::Truncated;
+            }
+            instruction.displacement = (uint16_t{bytes[3]} << 8) | uint16_t{bytes[2]};
+            instruction.length = 4;
+        }
+
+        return DecodeStatus::Ok;
+    } else if ((byte & ~0b1) == 0b11000110) {
+        instruction.kind = InstructionKind::MovImmediateToRegisterMemory;
+        instruction.W = byte & 1;
+        return DecodeStatus::NotImplemented;
+    } else if ((byte & ~0b1111) == 0b10110000) {
+        instruction.kind = InstructionKind::MovImmediateToRegister;
+        instruction.W = (byte >> 3) & 1;
+        instruction.reg = byte & 0b111;
+
+        auto length = instruction.W ? 3 : 2;
+        if (bytes.size() < static_cast<size_t>(length)) {
+            return DecodeStatus::Truncated;
+        }
+
+        instruction.immediate = instruction.W ? (uint16_t{bytes[2]} << 8) | uint16_t{bytes[1]} : bytes[1];
+        instruction.length = length;
+        return DecodeStatus::Ok;
+    } else if ((byte & ~0b1) == 0b10100000) {
+        instruction.kind = InstructionKind::MovMemoryToAccumulator;
+        instruction.W = byte & 1;
+        return DecodeStatus::NotImplemented;
+    } else if ((byte & ~0b1) == 0b10100010) {
+        instruction.kind = InstructionKind::MovAccumulatorToMemory;
+        instruction.W = byte & 1;
+        return DecodeStatus::NotImplemented;
+    } else if ((byte & ~0b1111) == 0b01110000 || (byte & ~0b11) == 0b11100000 || byte == 0b11101011) {
+        if (byte == 0b11101011) {
+            instruction.kind = InstructionKind::JumpShort;
+        } else if ((byte & ~0b1111) == 0b01110000) {
+            instruction.kind = InstructionKind::ConditionalJump;
+        } else {
+            instruction.kind = InstructionKind::Loop;
+        }
+
+        if (bytes.size() < 2) {
+            return DecodeStatus::Truncated;
+        }
+
+        instruction.displacement = static_cast<uint16_t>(static_cast<int8_t>(bytes[1]));
+        instruction.length = 2;
+        return DecodeStatus::Ok;
+    } else if ((byte & ~0b1) == 0b11101000) {
+        instruction.kind = byte & 1 ? InstructionKind::JumpNear : InstructionKind::CallNear;
+        if (bytes.size() < 3) {
+            return DecodeStatus::Truncated;
+        }
+
+        instruction.displacement = (uint16_t{bytes[2]} << 8) | uint16_t{bytes[1]};
+        instruction.length = 3;
+        return DecodeStatus::Ok;
+    } else if (byte == 0b11000011) {
+        instruction.kind = InstructionKind::Return;
+        return DecodeStatus::Ok;
+    } else if (byte == 0b11000010) {
+        instruction.kind = InstructionKind::ReturnImmediate;
+        if (bytes.size() < 3) {
+            return DecodeStatus::Truncated;
+        }
+
+        instruction.immediate = (uint16_t{bytes[2]} << 8) | uint16_t{bytes[1]};
+        instruction.length = 3;
+        return DecodeStatus::Ok;
+    }
+
+    return DecodeStatus::Unknown;
+}
+
+// Bounds are guaranteed by maxInstructionTextLength, so the writer does no checks of its own
+struct TextWriter {
+    char *cursor;
+
+    [[gnu::always_inline]] void append(std::string_view text) {
+        std::memcpy(cursor, text.data(), text.size());
+        cursor += text.size();
+    }
+
+    [[gnu::always_inline]] void append(uint16_t value) {
+        cursor = std::to_chars(cursor, cursor + 5, value).ptr;
+    }
+
+    // NASM's `$+N`/`$-N`, relative to the start of the instruction
+    [[gnu::always_inline]] void appendRelative(int32_t offset) {
+        append(offset < 0 ? "$-" : "$+");
+        append(static_cast<uint16_t>(offset < 0 ? -offset : offset));
+    }
+
+    [[gnu::always_inline]] void appendRegisterMemory(const DecodedInstruction &instruction) {
+        if (instruction.mod == 0b11) {
+            append(decodeRegister(instruction.rm, instruction.W));
+        } else if (instruction.mod == 0b00 && instruction.rm == 0b110) {
+            append("[");
+            append(instruction.displacement);
+            append("]");
+        } else if (instruction.mod == 0b00) {
+            append(memoryModeEffectiveAddress(instruction.rm));
+        } else {
+            appendEffectiveAddress(instruction.rm, instruction.displacement);
+        }
+    }
+
+    [[gnu::always_inline]] void appendEffectiveAddress(uint8_t rm, uint16_t displacement) {
+        append("[");
+        append(effectiveAddressBases[rm]);
+        if (displacement != 0) {
+            append(" + ");
+            append(displacement);
+        }
+        append("]");
+    }
+};
+
+[[gnu::always_inline]] inline size_t writeInstructionImpl(const DecodedInstruction &instruction, char *text) {
+    TextWriter writer{text};
+
+
+    switch (instruction.kind) {
+        case InstructionKind::MovRegisterMemory: {
+            auto reg = decodeRegister(instruction.reg, instruction.W);
+
+            // D=1: destination is specified in the REG field
+            writer.append("mov ");
+            if (instruction.D == 1) {
+                writer.append(reg);
+                writer.append(", ");
+                writer.appendRegisterMemory(instruction);
+            } else {
+                writer.appendRegisterMemory(instruction);
+                writer.append(", ");
+                writer.append(reg);
+            }
+            writer.append("\n");
+            break;
+        }
+        case InstructionKind::MovImmediateToRegister:
+            writer.append("mov ");
+            writer.append(decodeRegister(instruction.reg, instruction.W));
+            writer.append(", ");
+            writer.append(instruction.immediate);
+            writer.append("\n");
+            break;
+        case InstructionKind::ConditionalJump:
+        case InstructionKind::Loop:
+        case InstructionKind::JumpShort:
+        case InstructionKind::JumpNear:
+        case InstructionKind::CallNear:
+            writer.append(branchMnemonic(instruction));
+            writer.append(" ");
+            writer.appendRelative(instruction.length + static_cast<int16_t>(instruction.displacement));
+            writer.append("\n");
+            break;
+        case InstructionKind::Return:
+            writer.append("ret\n");
+            break;
+        case InstructionKind::ReturnImmediate:
+            writer.append("ret ");
+            writer.append(instruction.immediate);
+            writer.append("\n");
+            break;
+        default:
+            assert(false && "Formatting is not implemented for this instruction");
+            break;
+    }
+
+    return static_cast<size_t>(writer.cursor - text);
+}
+
+[[gnu::always_inline]] inline DisassemblyRun disassembleRunImpl(std::span<const uint8_t> bytes, std::span<char> text) {
+    DisassemblyRun run;
+
+    while (run.bytesConsumed < bytes.size() && text.size() - run.textLength >= maxInstructionTextLength) {
+        DecodedInstruction instruction;
+        run.status = decodeInstructionImpl(bytes.subspan(run.bytesConsumed), instruction);
+        if (run.status != DecodeStatus::Ok) {
+            break;
+        }
+
+        run.textLength += writeInstructionImpl(instruction, text.data() + run.textLength);
+        run.bytesConsumed += instruction.length;
+        run.instructions++;
+    }
+
+    return run;
+}
+
+DisassemblyRun disassembleRunScalar(std::span<const uint8_t> bytes, std::span<char> text) {
+    return disassembleRunImpl(bytes, text);
+}
+
+#ifdef DECODER_X86_DISPATCH
+
+[[gnu::target("sse4.2,popcnt")]]
+DisassemblyRun disassembleRunSse42(std::span<const uint8_t> bytes, std::span<char> text) {
+    return disassembleRunImpl(bytes, text);
+}
+
+[[gnu::target("avx2,bmi,bmi2,fma")]]
+DisassemblyRun disassembleRunAvx2(std::span<const uint8_t> bytes, std::span<char> text) {
+    return disassembleRunImpl(bytes, text);
+}
+
+[[gnu::target("avx512f,avx512bw,avx512vl,avx2,bmi,bmi2,fma")]]
+DisassemblyRun disassembleRunAvx512(std::span<const uint8_t> bytes, std::span<char> text) {
+    return disassembleRunImpl(bytes, text);
+}
+
+// Highest level whose instructions the CPU has and whose registers the OS saves on context switches
+DecoderIsa detectDecoderIsa() {
+    unsigned eax = 0, ebx = 0, ecx = 0, edx = 0;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_SSE4_2) || !(ecx & bit_POPCNT)) {
+        return DecoderIsa::Scalar;
+    }
+
+    uint64_t xcr0 = 0;
+    if (ecx & bit_OSXSAVE) {
+        uint32_t low = 0, high = 0;
+        __asm__("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+        xcr0 = (uint64_t{high} << 32) | low;
+    }
+    auto avxState = (xcr0 & 0b110) == 0b110;            // XMM and YMM
+    auto avx512State = (xcr0 & 0b11100110) == 0b11100110; // plus opmask and ZMM
+
+    auto avx = (ecx & bit_AVX) && (ecx & bit_FMA);
+    if (!avx || !avxState || !__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+        return DecoderIsa::Sse42;
+    }
+    if (!(ebx & bit_AVX2) || !(ebx & bit_BMI) || !(ebx & bit_BMI2)) {
+        return DecoderIsa::Sse42;
+    }
+    if (!(ebx & bit_AVX512F) || !(ebx & bit_AVX512BW) || !(ebx & bit_AVX512VL) || !avx512State) {
+        return DecoderIsa::Avx2;
+    }
+    return DecoderIsa::Avx512;
+}
+
+#else
+
+DecoderIsa detectDecoderIsa() {
+    return DecoderIsa::Scalar;
+}
+
+#endif
+
+using DisassembleRunKernel = DisassemblyRun (*)(std::span<const uint8_t>, std::span<char>);
+
+DisassembleRunKernel kernelFor(DecoderIsa isa) {
+    switch (isa) {
+#ifdef DECODER_X86_DISPATCH
+        case DecoderIsa::Sse42:
+            return disassembleRunSse42;
+        case DecoderIsa::Avx2:
+            return disassembleRunAvx2;
+        case DecoderIsa::Avx512:
+            return disassembleRunAvx512;
+#endif
+        default:
+            return disassembleRunScalar;
+    }
+}
+
+// CPUID runs once, before main(). forceDecoderIsa() may replace the choice later.
+const DecoderIsa detectedIsa = detectDecoderIsa();
+std::atomic<DecoderIsa> activeIsa{detectedIsa};
+
+// Per thread, so concurrent decoders don't contend on one cache line
+thread_local std::array<uint64_t, decoderIsaNames.size()> isaRuns{};
+
+DisassemblyRun runKernel(DecoderIsa isa, std::span<const uint8_t> bytes, std::span<char> text) {
+    isaRuns[static_cast<size_t>(isa)]++;
+    return kernelFor(isa)(bytes, text);
+}
+
+}
+
+DecodeStatus decodeInstruction(std::span<const uint8_t> bytes, DecodedInstruction &instruction) {
+    return decodeInstructionImpl(bytes, instruction);
+}
+
+size_t writeInstruction(const DecodedInstruction &instruction, std::span<char, maxInstructionTextLength> text) {
+    return writeInstructionImpl(instruction, text.data());
+}
+
+std::string formatInstruction(const DecodedInstruction &instruction) {
+    std::string out;
+    appendInstruction(out, instruction);
+    return out;
+}
+
+std::optional<DecoderIsa> parseDecoderIsa(std::string_view name) {
+    for (size_t i = 0; i < decoderIsaNames.size(); i++) {
+        if (decoderIsaNames[i] == name) {
+            return static_cast<DecoderIsa>(i);
+        }
+    }
+    return std::nullopt;
+}
+
+bool isDecoderIsaSupported(DecoderIsa isa) {
+    return isa <= detectedIsa;
+}
+
+DecoderIsa activeDecoderIsa() {
+    return activeIsa.load(std::memory_order_relaxed);
+}
+
+uint64_t decoderIsaRuns(DecoderIsa isa) {
+    return isaRuns[static_cast<size_t>(isa)];
+}
+
+bool forceDecoderIsa(DecoderIsa isa) {
+    if (!isDecoderIsaSupported(isa)) {
+        return false;
+    }
+    activeIsa.store(isa, std::memory_order_relaxed);
+    return true;
+}
+
+DisassemblyRun disassembleRun(DecoderIsa isa, std::span<const uint8_t> bytes, std::span<char> text) {
+    assert(isDecoderIsaSupported(isa));
+    return runKernel(isa, bytes, text);
+}
+
+DisassemblyRun disassembleRun(std::span<const uint8_t> bytes, std::span<char> text) {
+    return runKernel(activeDecoderIsa(), bytes, text);
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+
+// 8086 decode engine shared by the lesson executables. It is compiled once as the `decoder` library and
+// linked with LTO, so the lessons only add their own frontends (arguments, output, metrics) on top.
+
+enum class InstructionKind : uint8_t {
+    MovRegisterMemory,              // 100010dw mod reg r/m
+    MovImmediateToRegisterMemory,   // 1100011w mod 000 r/m
+    MovImmediateToRegister,         // 1011wreg
+    MovMemoryToAccumulator,         // 1010000w
+    MovAccumulatorToMemory,         // 1010001w
+    ConditionalJump,                // 0111cccc disp8
+    Loop,                           // 111000cc disp8: loopnz, loopz, loop, jcxz
+    JumpShort,                      // 11101011 disp8
+    JumpNear,                       // 11101001 disp16
+    CallNear,                       // 11101000 disp16
+    Return,                         // 11000011
+    ReturnImmediate,                // 11000010 data16
+};
+
+enum class DecodeStatus : uint8_t {
+    Ok,
+    Truncated,      // instruction runs past the end of the input
+    NotImplemented, // opcode is recognized, but its decoding is not implemented yet
+    Unknown,        // opcode is not recognized
+};
+
+// Fields of a single instruction, exactly as they were encoded. No text is produced at this stage,
+// so callers that only need the structure (statistics, analysis) don't pay for formatting.
+struct DecodedInstruction {
+    InstructionKind kind{};
+    uint8_t opcode = 0;
+    uint8_t length = 0;
+    uint8_t D = 0;
+    uint8_t W = 0;
+    uint8_t mod = 0;
+    uint8_t reg = 0;
+    uint8_t rm = 0;
+    uint16_t displacement = 0; // mod=00 r/m=110: the direct address. Branches: relative to the next
+                               // instruction, sign-extended to 16 bits
+    uint16_t immediate = 0;
+};
+
+// Jumps, loops and calls, whose target is displacement bytes past the end of the instruction
+inline bool isRelativeBranch(InstructionKind kind) {
+    return kind == InstructionKind::ConditionalJump || kind == InstructionKind::Loop ||
+           kind == InstructionKind::JumpShort || kind == InstructionKind::JumpNear ||
+           kind == InstructionKind::CallNear;
+}
+
+// Whether execution can continue with the next instruction
+inline bool fallsThrough(InstructionKind kind) {
+    return kind != InstructionKind::JumpShort && kind != InstructionKind::JumpNear &&
+           kind != InstructionKind::Return && kind != InstructionKind::ReturnImmediate;
+}
+
+// Indexed by r/m. With mod=00, r/m=110 is a direct address rather than [bp]
+inline constexpr std::array<std::string_view, 8> effectiveAddressBases = {
+        "bx + si", "bx + di", "bp + si", "bp + di", "si", "di", "bp", "bx",
+};
+
+// Longest line writeInstruction() produces, "mov cx, [bx + si + 65535]\n" rounded up
+inline constexpr size_t maxInstructionTextLength = 32;
+
+// Most text per byte of machine code, from a memory MOV without displacement: "mov al, [bx + si]\n" is
+// 18 characters for 2 bytes
+inline constexpr size_t maxInstructionTextPerByte = 9;
+
+std::string_view decodeRegister(uint8_t bits, bool W);
+
+// Effective address of a mod=00 operand, empty for r/m=110 whose direct address is in the displacement
+std::string_view memoryModeEffectiveAddress(uint8_t rm);
+
+// Mnemonic of a relative branch, with the `short`/`near` keyword that pins the encoding of jmp
+std::string_view branchMnemonic(const DecodedInstruction &instruction);
+
+// Decode the instruction at the start of bytes, which must not be empty
+DecodeStatus decodeInstruction(std::span<const uint8_t> bytes, DecodedInstruction &instruction);
+
+// NASM source line for a successfully decoded instruction, including the trailing newline.
+// Returns the number of characters written.
+size_t writeInstruction(const DecodedInstruction &instruction, std::span<char, maxInstructionTextLength> text);
+
+std::string formatInstruction(const DecodedInstruction &instruction);
+
+// Appends without a temporary string, whatever allocator the output uses
+template<typename Allocator>
+void appendInstruction(std::basic_string<char, std::char_traits<char>, Allocator> &out,
+                       const DecodedInstruction &instruction) {
+    std::array<char, maxInstructionTextLength> text;
+    out.append(text.data(), writeInstruction(instruction, text));
+}
+
+// Result of decoding and printing a run of instructions in one call
+struct DisassemblyRun {
+    size_t bytesConsumed = 0;
+    size_t instructions = 0;
+    size_t textLength = 0;
+    DecodeStatus status = DecodeStatus::Ok; // why the run stopped early, Ok if it ran out of input or text space
+};
+
+// ISA variants the hot kernel is compiled for. Each level includes the ones before it.
+enum class DecoderIsa : uint8_t {
+    Scalar, // baseline of the target, no runtime requirements
+    Sse42,
+    Avx2,
+    Avx512,
+};
+
+inline constexpr std::array<std::string_view, 4> decoderIsaNames = {"scalar", "sse4.2", "avx2", "avx512"};
+
+std::optional<DecoderIsa> parseDecoderIsa(std::string_view name);
+
+// Whether this CPU (and OS) can run the variant, detected once at startup through CPUID.
+// Off x86 only the scalar variant exists.
+bool isDecoderIsaSupported(DecoderIsa isa);
+
+// Variant disassembleRun() dispatches to, the best supported one unless forced
+DecoderIsa activeDecoderIsa();
+
+// How many times disassembleRun() ran the variant on the calling thread, e.g. for tests of the dispatch
+uint64_t decoderIsaRuns(DecoderIsa isa);
+
+// Select a variant for the whole process, e.g. for testing. Fails if the CPU doesn't support it.
+bool forceDecoderIsa(DecoderIsa isa);
+
+// Decode instructions from the start of bytes and print them into text, until the input ends, an
+// instruction fails to decode or less than maxInstructionTextLength characters of text are left
+DisassemblyRun disassembleRun(std::span<const uint8_t> bytes, std::span<char> text);
+
+// Same with an explicit variant, which must be supported
+DisassemblyRun disassembleRun(DecoderIsa isa, std::span<const uint8_t> bytes, std::span<char> text);
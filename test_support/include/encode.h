@@ -0,0 +1,476 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <charconv>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <ranges>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+// In-process assembler for the MOV forms, jumps, calls and returns of the 8086 that the listings and the
+// decoder's output use. It emits the same bytes as `nasm -f bin` (shortest displacement, accumulator short
+// forms), so round-trip tests can run in memory instead of spawning NASM and going through temporary files.
+
+enum class OperandType : uint8_t {
+    Register,
+    Memory,
+    Immediate,
+};
+
+struct Operand {
+    OperandType type{};
+    uint8_t reg = 0;               // Register: REG field encoding
+    uint8_t W = 0;                 // Register: 1 for 16-bit registers
+    std::optional<uint8_t> size{}; // Explicit `byte`/`word` keyword, as a W value
+    bool direct = false;           // Memory: [address] without registers
+    uint8_t rm = 0;                // Memory: R/M field encoding
+    int32_t value = 0;             // Memory: displacement, Immediate: the value
+};
+
+static std::optional<Operand> parseRegisterOperand(std::string_view name) {
+    static constexpr std::array<std::string_view, 8> bytes = {"al", "cl", "dl", "bl", "ah", "ch", "dh", "bh"};
+    static constexpr std::array<std::string_view, 8> words = {"ax", "cx", "dx", "bx", "sp", "bp", "si", "di"};
+
+    for (uint8_t i = 0; i < 8; i++) {
+        if (name == bytes[i]) {
+            return Operand{.type = OperandType::Register, .reg = i, .W = 0};
+        }
+        if (name == words[i]) {
+            return Operand{.type = OperandType::Register, .reg = i, .W = 1};
+        }
+    }
+
+    return std::nullopt;
+}
+
+static std::string_view trim(std::string_view text) {
+    auto first = text.find_first_not_of(" \t\r\n");
+    if (first == std::string_view::npos) {
+        return {};
+    }
+    auto last = text.find_last_not_of(" \t\r\n");
+    return text.substr(first, last - first + 1);
+}
+
+static std::optional<int32_t> parseNumber(std::string_view text) {
+    auto negative = false;
+    if (!text.empty() && (text.front() == '-' || text.front() == '+')) {
+        negative = text.front() == '-';
+        text = trim(text.substr(1));
+    }
+
+    auto base = 10;
+    if (text.starts_with("0x")) {
+        base = 16;
+        text.remove_prefix(2);
+    }
+
+    int32_t value = 0;
+    auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value, base);
+    if (text.empty() || error != std::errc{} || end != text.data() + text.size()) {
+        return std::nullopt;
+    }
+
+    return negative ? -value : value;
+}
+
+// Parse the inside of [...]: up to one base (bx/bp), up to one index (si/di) and any number of constants
+static std::optional<Operand> parseMemoryOperand(std::string_view expression) {
+    std::optional<uint8_t> base;
+    std::optional<uint8_t> index;
+    int32_t displacement = 0;
+    bool hasConstant = false;
+
+    while (!(expression = trim(expression)).empty()) {
+        auto negative = false;
+        if (expression.front() == '+' || expression.front() == '-') {
+            negative = expression.front() == '-';
+            expression.remove_prefix(1);
+        }
+
+        auto termEnd = expression.find_first_of("+-");
+        auto term = trim(expression.substr(0, termEnd));
+        expression = termEnd == std::string_view::npos ? std::string_view{} : expression.substr(termEnd);
+
+        if (term == "bx" || term == "bp") {
+            if (negative || base.has_value()) {
+                return std::nullopt;
+            }
+            base = term == "bx" ? 0b011 : 0b101;
+        } else if (term == "si" || term == "di") {
+            if (negative || index.has_value()) {
+                return std::nullopt;
+            }
+            index = term == "si" ? 0b110 : 0b111;
+        } else if (auto number = parseNumber(term)) {
+            displacement += negative ? -number.value() : number.value();
+            hasConstant = true;
+        } else {
+            return std::nullopt;
+        }
+    }
+
+    if (displacement < -32768 || displacement > 65535) {
+        return std::nullopt;
+    }
+
+    Operand operand{.type = OperandType::Memory, .value = displacement};
+    if (!base.has_value() && !index.has_value()) {
+        if (!hasConstant) {
+            return std::nullopt;
+        }
+        operand.direct = true;
+    } else if (base.has_value() && index.has_value()) {
+        operand.rm = static_cast<uint8_t>((base == 0b101 ? 0b010 : 0b000) | (index == 0b111 ? 0b001 : 0b000));
+    } else if (index.has_value()) {
+        operand.rm = index == 0b110 ? 0b100 : 0b101;
+    } else {
+        operand.rm = base == 0b101 ? 0b110 : 0b111;
+    }
+
+    return operand;
+}
+
+static std::optional<Operand> parseOperand(std::string_view text) {
+    std::optional<uint8_t> size;
+    if (text.starts_with("byte ") || text.starts_with("word ")) {
+        size = text.starts_with("word") ? 1 : 0;
+        text = trim(text.substr(5));
+    }
+
+    std::optional<Operand> operand;
+    if (text.starts_with('[') && text.ends_with(']')) {
+        operand = parseMemoryOperand(text.substr(1, text.size() - 2));
+    } else if (auto reg = parseRegisterOperand(text)) {
+        operand = reg;
+    } else if (auto number = parseNumber(text)) {
+        operand = Operand{.type = OperandType::Immediate, .value = number.value()};
+    }
+
+    if (operand.has_value()) {
+        operand->size = size;
+    }
+    return operand;
+}
+
+static void appendWord(std::vector<uint8_t> &out, int32_t value) {
+    out.push_back(static_cast<uint8_t>(value & 0xff));
+    out.push_back(static_cast<uint8_t>((value >> 8) & 0xff));
+}
+
+static bool appendImmediate(std::vector<uint8_t> &out, int32_t value, uint8_t W) {
+    if (W == 0 ? (value < -128 || value > 255) : (value < -32768 || value > 65535)) {
+        return false;
+    }
+
+    out.push_back(static_cast<uint8_t>(value & 0xff));
+    if (W == 1) {
+        out.push_back(static_cast<uint8_t>((value >> 8) & 0xff));
+    }
+    return true;
+}
+
+// mod reg r/m byte plus displacement, using the shortest displacement that holds the value
+static void appendModRm(std::vector<uint8_t> &out, uint8_t reg, const Operand &memory) {
+    if (memory.direct) {
+        out.push_back(static_cast<uint8_t>((reg << 3) | 0b110));
+        appendWord(out, memory.value);
+        return;
+    }
+
+    auto displacement = static_cast<int16_t>(static_cast<uint16_t>(memory.value));
+    if (displacement == 0 && memory.rm != 0b110) {
+        out.push_back(static_cast<uint8_t>((0b00 << 6) | (reg << 3) | memory.rm));
+    } else if (displacement >= -128 && displacement <= 127) {
+        out.push_back(static_cast<uint8_t>((0b01 << 6) | (reg << 3) | memory.rm));
+        out.push_back(static_cast<uint8_t>(displacement & 0xff));
+    } else {
+        out.push_back(static_cast<uint8_t>((0b10 << 6) | (reg << 3) | memory.rm));
+        appendWord(out, displacement);
+    }
+}
+
+static bool encodeMov(const Operand &dst, const Operand &src, std::vector<uint8_t> &out) {
+    using enum OperandType;
+
+    if (dst.type == Register && src.type == Register) {
+        if (dst.W != src.W) {
+            return false;
+        }
+        out.push_back(static_cast<uint8_t>(0b10001000 | dst.W));
+        out.push_back(static_cast<uint8_t>((0b11 << 6) | (src.reg << 3) | dst.reg));
+        return true;
+    }
+
+    if (dst.type == Register && src.type == Immediate) {
+        out.push_back(static_cast<uint8_t>(0b10110000 | (dst.W << 3) | dst.reg));
+        return appendImmediate(out, src.value, dst.W);
+    }
+
+    if (dst.type == Register && src.type == Memory) {
+        if (dst.reg == 0 && src.direct) {
+            out.push_back(static_cast<uint8_t>(0b10100000 | dst.W));
+            appendWord(out, src.value);
+            return true;
+        }
+        out.push_back(static_cast<uint8_t>(0b10001010 | dst.W));
+        appendModRm(out, dst.reg, src);
+        return true;
+    }
+
+    if (dst.type == Memory && src.type == Register) {
+        if (src.reg == 0 && dst.direct) {
+            out.push_back(static_cast<uint8_t>(0b10100010 | src.W));
+            appendWord(out, dst.value);
+            return true;
+        }
+        out.push_back(static_cast<uint8_t>(0b10001000 | src.W));
+        appendModRm(out, src.reg, dst);
+        return true;
+    }
+
+    if (dst.type == Memory && src.type == Immediate) {
+        auto size = src.size.has_value() ? src.size : dst.size;
+        if (!size.has_value()) {
+            return false;
+        }
+        out.push_back(static_cast<uint8_t>(0b11000110 | size.value()));
+        appendModRm(out, 0b000, dst);
+        return appendImmediate(out, src.value, size.value());
+    }
+
+    return false;
+}
+
+// Offsets of the labels seen so far. assemble() runs passes until they stop moving, so references to
+// labels further down resolve with the offsets of the previous pass.
+struct LabelTable {
+    std::map<std::string, int32_t, std::less<>> offsets{};
+    bool final = true;       // unknown labels are errors, otherwise they stand in for `$` until a later pass
+    bool unresolved = false; // set when a pass used such a stand-in
+};
+
+static bool isLabelName(std::string_view name) {
+    auto isStart = [](unsigned char c) { return std::isalpha(c) || c == '_' || c == '.'; };
+    auto isPart = [&](unsigned char c) { return isStart(c) || std::isdigit(c); };
+    return !name.empty() && isStart(name.front()) && std::ranges::all_of(name, isPart);
+}
+
+// Branch target: `$`, `$+N`, `$-N`, a label or an absolute offset
+static std::optional<int32_t> parseBranchTarget(std::string_view text, int32_t offset, LabelTable *labels) {
+    if (text.starts_with('$')) {
+        text = trim(text.substr(1));
+        if (text.empty()) {
+            return offset;
+        }
+        auto delta = text.front() == '+' || text.front() == '-' ? parseNumber(text) : std::nullopt;
+        return delta.has_value() ? std::optional{offset + delta.value()} : std::nullopt;
+    }
+
+    if (auto number = parseNumber(text)) {
+        return number;
+    }
+
+    if (labels == nullptr || !isLabelName(text)) {
+        return std::nullopt;
+    }
+    if (auto label = labels->offsets.find(text); label != labels->offsets.end()) {
+        return label->second;
+    }
+    if (labels->final) {
+        spdlog::error("Unknown label {}", text);
+        return std::nullopt;
+    }
+    labels->unresolved = true;
+    return offset;
+}
+
+static std::optional<uint8_t> shortBranchOpcode(std::string_view mnemonic) {
+    static constexpr std::array<std::pair<std::string_view, uint8_t>, 36> opcodes = {{
+            {"jo", 0x70},     {"jno", 0x71},   {"jb", 0x72},    {"jc", 0x72},     {"jnae", 0x72}, {"jnb", 0x73},
+            {"jnc", 0x73},    {"jae", 0x73},   {"je", 0x74},    {"jz", 0x74},     {"jne", 0x75},  {"jnz", 0x75},
+            {"jbe", 0x76},    {"jna", 0x76},   {"ja", 0x77},    {"jnbe", 0x77},   {"js", 0x78},   {"jns", 0x79},
+            {"jp", 0x7a},     {"jpe", 0x7a},   {"jnp", 0x7b},   {"jpo", 0x7b},    {"jl", 0x7c},   {"jnge", 0x7c},
+            {"jnl", 0x7d},    {"jge", 0x7d},   {"jle", 0x7e},   {"jng", 0x7e},    {"jg", 0x7f},   {"jnle", 0x7f},
+            {"loopnz", 0xe0}, {"loopne", 0xe0}, {"loopz", 0xe1}, {"loope", 0xe1}, {"loop", 0xe2}, {"jcxz", 0xe3},
+    }};
+
+    for (auto [name, opcode]: opcodes) {
+        if (name == mnemonic) {
+            return opcode;
+        }
+    }
+    return std::nullopt;
+}
+
+// Jumps, loops and calls. Returns nothing if the mnemonic is not one of them.
+static std::optional<bool> encodeBranch(std::string_view mnemonic, std::string_view operand, std::vector<uint8_t> &out,
+                                        LabelTable *labels) {
+    auto shortOpcode = shortBranchOpcode(mnemonic);
+    if (!shortOpcode.has_value() && mnemonic != "jmp" && mnemonic != "call") {
+        return std::nullopt;
+    }
+
+    std::optional<bool> near;
+    if (operand.starts_with("short ") || operand.starts_with("near ")) {
+        near = operand.starts_with("near");
+        operand = trim(operand.substr(operand.find(' ')));
+    }
+
+    auto offset = static_cast<int32_t>(out.size());
+    auto target = parseBranchTarget(operand, offset, labels);
+    if (!target.has_value()) {
+        return false;
+    }
+
+    auto shortDisplacement = target.value() - (offset + 2);
+    auto fitsShort = shortDisplacement >= -128 && shortDisplacement <= 127;
+
+    // Conditional jumps and loops only have the short form. A bare jmp takes it when the target is in reach.
+    auto isShort = shortOpcode.has_value() || near == false || (mnemonic == "jmp" && !near.has_value() && fitsShort);
+    if (isShort) {
+        if (near == true || !fitsShort || mnemonic == "call") {
+            return false;
+        }
+        out.push_back(shortOpcode.value_or(0b11101011));
+        out.push_back(static_cast<uint8_t>(shortDisplacement & 0xff));
+        return true;
+    }
+
+    // The instruction pointer wraps around at 64 KiB, so every near target is reachable
+    out.push_back(mnemonic == "jmp" ? 0b11101001 : 0b11101000);
+    appendWord(out, target.value() - (offset + 3));
+    return true;
+}
+
+// Assemble one line of source, appending its bytes. Blank lines, comments and `bits 16` produce nothing.
+// Labels are recorded in labels; without a table they are ignored and can't be referenced.
+static bool assembleLine(std::string_view line, std::vector<uint8_t> &out, LabelTable *labels = nullptr) {
+    line = trim(line.substr(0, line.find(';')));
+    if (line.empty()) {
+        return true;
+    }
+
+    std::string lowered{line};
+    std::ranges::transform(lowered, lowered.begin(), [](unsigned char c) { return std::tolower(c); });
+    std::string_view text{lowered};
+
+    auto mnemonicEnd = text.find_first_of(" \t");
+    auto mnemonic = text.substr(0, mnemonicEnd);
+    auto operands = mnemonicEnd == std::string_view::npos ? std::string_view{} : trim(text.substr(mnemonicEnd));
+
+    if (mnemonic == "bits") {
+        return parseNumber(operands) == 16;
+    }
+
+    if (mnemonic.ends_with(':')) {
+        auto name = mnemonic.substr(0, mnemonic.size() - 1);
+        if (!isLabelName(name)) {
+            return false;
+        }
+        if (labels != nullptr) {
+            labels->offsets.insert_or_assign(std::string{name}, static_cast<int32_t>(out.size()));
+        }
+        return assembleLine(operands, out, labels);
+    }
+
+    if (auto branch = encodeBranch(mnemonic, operands, out, labels)) {
+        return branch.value();
+    }
+
+    if (mnemonic == "ret") {
+        if (operands.empty()) {
+            out.push_back(0b11000011);
+            return true;
+        }
+        auto popped = parseNumber(operands);
+        if (!popped.has_value() || popped.value() < 0 || popped.value() > 65535) {
+            return false;
+        }
+        out.push_back(0b11000010);
+        appendWord(out, popped.value());
+        return true;
+    }
+
+    if (mnemonic == "db") {
+        for (auto item: std::views::split(operands, ',')) {
+            auto value = parseNumber(trim(std::string_view{item.begin(), item.end()}));
+            if (!value.has_value() || !appendImmediate(out, value.value(), 0)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    if (mnemonic != "mov") {
+        return false;
+    }
+
+    auto comma = operands.find(',');
+    if (comma == std::string_view::npos) {
+        return false;
+    }
+
+    auto dst = parseOperand(trim(operands.substr(0, comma)));
+    auto src = parseOperand(trim(operands.substr(comma + 1)));
+    if (!dst.has_value() || !src.has_value()) {
+        return false;
+    }
+
+    auto size = out.size();
+    if (!encodeMov(dst.value(), src.value(), out)) {
+        out.resize(size);
+        return false;
+    }
+    return true;
+}
+
+static std::optional<std::vector<uint8_t>> assemblePass(std::string_view source, LabelTable &labels) {
+    std::vector<uint8_t> out;
+    out.reserve(source.size() / 4);
+
+    size_t lineNo = 1;
+    for (auto line: std::views::split(source, '\n')) {
+        std::string_view text{line.begin(), line.end()};
+        if (!assembleLine(text, out, &labels)) {
+            spdlog::error("Failed to assemble line {}: {}", lineNo, text);
+            return std::nullopt;
+        }
+        lineNo++;
+    }
+
+    return out;
+}
+
+// Source without forward references takes one pass. A bare `jmp` picks short or near from the distance,
+// which can move the labels after it, so passes repeat until no label moves.
+static std::optional<std::vector<uint8_t>> assemble(std::string_view source) {
+    constexpr auto maxPasses = 16;
+
+    LabelTable labels{.final = false};
+    for (auto pass = 0; pass < maxPasses; pass++) {
+        auto previous = labels.offsets;
+        labels.unresolved = false;
+
+        auto out = assemblePass(source, labels);
+        if (!out.has_value() || labels.final) {
+            return out;
+        }
+        if (labels.offsets == previous) {
+            if (!labels.unresolved) {
+                return out;
+            }
+            labels.final = true; // a label is never defined, the next pass reports where
+        }
+    }
+
+    spdlog::error("Label offsets did not settle after {} passes", maxPasses);
+    return std::nullopt;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+// Appends random instructions of the forms the decoder supports until out has at least size bytes:
+// register/memory MOV with every mod, displacement and direct address, immediate to register
+// MOV, and jumps, loops, calls and returns with random displacements. Shared by the tests and the fuzz
+// replay driver, so every random stream comes from one seeded generator.
+static void appendInstructionStream(std::mt19937 &random, size_t size, std::vector<uint8_t> &out) {
+    static constexpr std::array<uint8_t, 8> branches = {0x70, 0x7f, 0xe0, 0xe3, 0xeb, 0xe9, 0xe8, 0xc3};
+    auto byte = [&] { return static_cast<uint8_t>(random()); };
+
+    while (out.size() < size) {
+        auto form = random() % 8;
+        if (form < 4) {
+            auto modRm = byte();
+            out.insert(out.end(), {static_cast<uint8_t>(0b10001000 | (random() & 0b11)), modRm});
+            auto mod = modRm >> 6;
+            auto direct = mod == 0b00 && (modRm & 0b111) == 0b110;
+            for (auto n = mod == 0b01 ? 1 : (mod == 0b10 || direct) ? 2 : 0; n > 0; n--) {
+                out.push_back(byte());
+            }
+        } else if (form < 6) {
+            auto opcode = static_cast<uint8_t>(0b10110000 | (random() & 0b1111));
+            out.insert(out.end(), {opcode, byte()});
+            if (opcode & 0b1000) {
+                out.push_back(byte());
+            }
+        } else {
+            auto opcode = branches[random() % branches.size()];
+            out.push_back(opcode);
+            if (opcode != 0xc3) {
+                out.push_back(byte());
+            }
+            if (opcode == 0xe8 || opcode == 0xe9) {
+                out.push_back(byte());
+            }
+        }
+    }
+}
+
+static std::vector<uint8_t> generateInstructionStream(size_t size, uint32_t seed) {
+    std::mt19937 random(seed);
+    std::vector<uint8_t> out;
+    out.reserve(size + 4);
+    appendInstructionStream(random, size, out);
+    return out;
+}
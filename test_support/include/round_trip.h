@@ -0,0 +1,117 @@
+#pragma once
+
+#include <format>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <decoder.h>
+#include <encode.h>
+
+// Reference path for checking the decoder: print an instruction, assemble the text with the in-process
+// encoder and decode the result again. Both decodes must describe the same operation, even when the
+// encoder picks a different one of the equivalent encodings.
+
+// What an instruction does, independent of which of the equivalent encodings was used
+struct Semantics {
+    InstructionKind kind{};
+    uint8_t W = 0;
+    uint8_t destination = 0; // 0-7 register, 8-15 memory with r/m, 16 immediate, 17 direct address
+    uint8_t source = 0;
+    uint16_t displacement = 0;
+    uint16_t immediate = 0;
+
+    bool operator==(const Semantics &) const = default;
+};
+
+static constexpr uint8_t immediateOperand = 16;
+static constexpr uint8_t directAddressOperand = 17;
+
+static Semantics semanticsOf(const DecodedInstruction &instruction) {
+    Semantics semantics{.kind = instruction.kind, .W = instruction.W};
+
+    if (instruction.kind == InstructionKind::MovImmediateToRegister) {
+        semantics.destination = instruction.reg;
+        semantics.source = immediateOperand;
+        semantics.immediate = instruction.immediate;
+        return semantics;
+    }
+
+    // Which branch it is and how far it goes, or how many bytes ret pops
+    if (isRelativeBranch(instruction.kind) || instruction.kind == InstructionKind::Return ||
+        instruction.kind == InstructionKind::ReturnImmediate) {
+        semantics.destination = instruction.opcode & 0b1111;
+        semantics.displacement = instruction.displacement;
+        semantics.immediate = instruction.immediate;
+        return semantics;
+    }
+
+    auto regOperand = instruction.reg;
+    auto direct = instruction.mod == 0b00 && instruction.rm == 0b110;
+    auto rmOperand = static_cast<uint8_t>(instruction.mod == 0b11 ? instruction.rm
+                                          : direct                ? directAddressOperand
+                                                                  : 8 + instruction.rm);
+    semantics.destination = instruction.D ? regOperand : rmOperand;
+    semantics.source = instruction.D ? rmOperand : regOperand;
+
+    // The CPU sign-extends 8-bit displacements
+    if (instruction.mod == 0b01) {
+        semantics.displacement = static_cast<uint16_t>(static_cast<int8_t>(instruction.displacement));
+    } else if (instruction.mod == 0b10 || direct) {
+        semantics.displacement = instruction.displacement;
+    }
+
+    return semantics;
+}
+
+// Register/memory MOVs that don't survive the round trip yet (see DISABLED_ExtraComplex in
+// disassebling_tests.cpp): 8-bit displacements that need sign extension, including 16-bit ones that the
+// encoder will shorten to such an 8-bit displacement, and direct addresses with al or ax, which the
+// encoder turns into the accumulator MOV the decoder doesn't implement.
+static bool isSupportedRegisterMemory(uint8_t mod, uint8_t reg, uint8_t rm, uint16_t displacement) {
+    switch (mod) {
+        case 0b00:
+            return rm != 0b110 || reg != 0b000;
+        case 0b01:
+            return displacement < 0x80;
+        case 0b10:
+            return displacement < 0xff80;
+        default:
+            return true;
+    }
+}
+
+static bool isRoundTripSupported(const DecodedInstruction &instruction) {
+    return instruction.kind != InstructionKind::MovRegisterMemory ||
+           isSupportedRegisterMemory(instruction.mod, instruction.reg, instruction.rm, instruction.displacement);
+}
+
+static std::string hexBytes(std::span<const uint8_t> bytes) {
+    std::string out;
+    for (auto byte: bytes) {
+        out.append(std::format("{}{:02x}", out.empty() ? "" : " ", byte));
+    }
+    return out;
+}
+
+// Why the decoded instruction does not survive the round trip, nothing if it does
+static std::optional<std::string> roundTripMismatch(const DecodedInstruction &decoded) {
+    auto text = formatInstruction(decoded);
+    std::vector<uint8_t> reencoded;
+    if (!assembleLine(text, reencoded)) {
+        return std::format("encoder rejected `{}`", trim(text));
+    }
+
+    DecodedInstruction redecoded;
+    if (reencoded.empty() || decodeInstruction(reencoded, redecoded) != DecodeStatus::Ok ||
+        redecoded.length != reencoded.size()) {
+        return std::format("re-encoded `{}` as {} which does not decode", trim(text), hexBytes(reencoded));
+    }
+
+    if (semanticsOf(decoded) != semanticsOf(redecoded)) {
+        return std::format("`{}` re-encodes as {}", trim(text), hexBytes(reencoded));
+    }
+
+    return std::nullopt;
+}